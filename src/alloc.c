@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "alloc.h"
+
+// The C library's allocator, used until simplet_set_allocator is called.
+static void *
+default_malloc(size_t size, void *ctx){
+  (void) ctx;
+  return malloc(size);
+}
+
+static void *
+default_realloc(void *ptr, size_t size, void *ctx){
+  (void) ctx;
+  return realloc(ptr, size);
+}
+
+static void
+default_free(void *ptr, void *ctx){
+  (void) ctx;
+  free(ptr);
+}
+
+static struct {
+  simplet_malloc_fn malloc_fn;
+  simplet_realloc_fn realloc_fn;
+  simplet_free_fn free_fn;
+  void *ctx;
+} allocator = { default_malloc, default_realloc, default_free, NULL };
+
+// Route every allocation simple-tiles makes through malloc_fn, realloc_fn and
+// free_fn, each called with ctx. GDAL, cairo and Pango keep their own
+// allocators. Passing NULL functions restores the C library's allocator.
+//
+// The hooks must be set before anything is allocated, usually before the
+// first map is created, and can't be changed while simple-tiles memory is
+// still live. Strings and other memory simple-tiles hands back to the caller
+// have to be released with simplet_free when custom hooks are set.
+void
+simplet_set_allocator(simplet_malloc_fn malloc_fn, simplet_realloc_fn realloc_fn,
+  simplet_free_fn free_fn, void *ctx){
+  if(!malloc_fn || !realloc_fn || !free_fn) {
+    malloc_fn  = default_malloc;
+    realloc_fn = default_realloc;
+    free_fn    = default_free;
+    ctx        = NULL;
+  }
+
+  allocator.malloc_fn  = malloc_fn;
+  allocator.realloc_fn = realloc_fn;
+  allocator.free_fn    = free_fn;
+  allocator.ctx        = ctx;
+}
+
+// Allocate size bytes, returns NULL on failure.
+void*
+simplet_malloc(size_t size){
+  return allocator.malloc_fn(size, allocator.ctx);
+}
+
+// Allocate count zeroed elements of size bytes, returns NULL on failure or
+// overflow.
+void*
+simplet_calloc(size_t count, size_t size){
+  if(size && count > SIZE_MAX / size)
+    return NULL;
+
+  void *ptr;
+  if((ptr = simplet_malloc(count * size)))
+    memset(ptr, 0, count * size);
+  return ptr;
+}
+
+// Resize memory from simplet_malloc, returns NULL on failure and leaves ptr
+// alone.
+void*
+simplet_realloc(void *ptr, size_t size){
+  return allocator.realloc_fn(ptr, size, allocator.ctx);
+}
+
+// Free memory from simplet_malloc, NULL is ignored.
+void
+simplet_free(void *ptr){
+  if(ptr) allocator.free_fn(ptr, allocator.ctx);
+}
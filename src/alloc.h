@@ -0,0 +1,35 @@
+#ifndef _SIMPLE_TILES_ALLOC_H
+#define _SIMPLE_TILES_ALLOC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Allocation hooks, ctx is the pointer given to simplet_set_allocator.
+typedef void *(*simplet_malloc_fn)(size_t size, void *ctx);
+typedef void *(*simplet_realloc_fn)(void *ptr, size_t size, void *ctx);
+typedef void (*simplet_free_fn)(void *ptr, void *ctx);
+
+void
+simplet_set_allocator(simplet_malloc_fn malloc_fn, simplet_realloc_fn realloc_fn,
+  simplet_free_fn free_fn, void *ctx);
+
+void*
+simplet_malloc(size_t size);
+
+void*
+simplet_calloc(size_t count, size_t size);
+
+void*
+simplet_realloc(void *ptr, size_t size);
+
+void
+simplet_free(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
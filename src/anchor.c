@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "anchor.h"
+#include "alloc.h"
+
+// A cached anchor in the projection of its data source, with the envelope
+// of the geometry it was measured from.
+typedef struct {
+  unsigned int ns;
+  GIntBig fid;
+  OGREnvelope envelope;
+  double x;
+  double y;
+  int valid;
+} anchor_t;
+
+// The process wide anchor cache. Each feature maps to a single slot, and a
+// new anchor simply replaces whatever was there, which keeps the cache
+// bounded without any bookkeeping. Namespaces tell apart features with the
+// same FID from different sources or queries.
+static struct {
+  pthread_mutex_t lock;
+  anchor_t *slots;
+  char **namespaces;
+  unsigned int namespaces_length;
+  unsigned long hits;
+  unsigned long misses;
+} cache = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0, 0 };
+
+// Return the id of the namespace for features read from source with sql,
+// creating it if this is the first time it's been seen. Returns 0, meaning
+// anchors aren't cached, on failure.
+unsigned int
+simplet_anchor_namespace(const char *source, const char *sql){
+  size_t length = strlen(source) + strlen(sql) + 2;
+  char *key;
+  if(!(key = simplet_malloc(length)))
+    return 0;
+  snprintf(key, length, "%s\n%s", source, sql);
+
+  pthread_mutex_lock(&cache.lock);
+  unsigned int ns = 0;
+  for(unsigned int i = 0; i < cache.namespaces_length && !ns; i++)
+    if(!strcmp(cache.namespaces[i], key))
+      ns = i + 1;
+
+  if(!ns) {
+    char **namespaces;
+    if((namespaces = simplet_realloc(cache.namespaces, (cache.namespaces_length + 1) * sizeof(*namespaces)))) {
+      cache.namespaces = namespaces;
+      cache.namespaces[cache.namespaces_length++] = key;
+      ns = cache.namespaces_length;
+      key = NULL;
+    }
+  }
+  pthread_mutex_unlock(&cache.lock);
+
+  simplet_free(key);
+  return ns;
+}
+
+// Find the anchor of a geometry: the centroid of its largest part.
+static int
+compute_anchor(OGRGeometryH super, double *x, double *y){
+  if(!super) return 0;
+
+  // Find the largest sub geometry of a particular multi-geometry.
+  OGRGeometryH geom = super;
+  double area = 0.0;
+  switch(wkbFlatten(OGR_G_GetGeometryType(super))) {
+    case wkbMultiPolygon:
+    case wkbGeometryCollection:
+      for(int i = 0; i < OGR_G_GetGeometryCount(super); i++) {
+        OGRGeometryH subgeom = OGR_G_GetGeometryRef(super, i);
+        if(subgeom == NULL) continue;
+        double ar = OGR_G_Area(subgeom);
+        if(ar > area) {
+          geom = subgeom;
+          area = ar;
+        }
+      }
+      break;
+    default:
+      ;
+  }
+
+  // Find the center of our geometry. This sometimes throws an invalid geometry
+  // error, so there is a slight bug here somehow.
+  OGRGeometryH center;
+  if(!(center = OGR_G_CreateGeometry(wkbPoint))) return 0;
+  if(OGR_G_Centroid(geom, center) == OGRERR_FAILURE) {
+    OGR_G_DestroyGeometry(center);
+    return 0;
+  }
+
+  *x = OGR_G_GetX(center, 0);
+  *y = OGR_G_GetY(center, 0);
+  OGR_G_DestroyGeometry(center);
+  return 1;
+}
+
+// Hash a feature into a slot.
+static unsigned int
+slot(unsigned int ns, GIntBig fid){
+  unsigned long long h = (unsigned long long) fid * 0x9E3779B97F4A7C15ULL ^ ns;
+  return (unsigned int) (h ^ (h >> 32)) & (SIMPLET_ANCHOR_CACHE_SIZE - 1);
+}
+
+// Check if two envelopes are exactly the same.
+static int
+same_envelope(OGREnvelope *a, OGREnvelope *b){
+  return a->MinX == b->MinX && a->MaxX == b->MaxX
+      && a->MinY == b->MinY && a->MaxY == b->MaxY;
+}
+
+// Find the label anchor for a feature whose geometry is still in the
+// projection of its source, and transform it to the map. Anchors are cached
+// by namespace and FID so features that show up on several tiles or zoom
+// levels are only measured once. Features without an FID, or an ns of 0,
+// aren't cached. Some drivers number the rows of each SQL result rather than
+// report a stable FID, so a cached anchor is only used if the feature's
+// envelope matches the one it was measured from. Returns 0 if the feature
+// has no anchor.
+int
+simplet_anchor_find(unsigned int ns, OGRFeatureH feature,
+  OGRCoordinateTransformationH transform, double *x, double *y){
+  GIntBig fid = OGR_F_GetFID(feature);
+  int cacheable = ns && fid != OGRNullFID;
+  anchor_t anchor;
+  memset(&anchor, 0, sizeof(anchor));
+  anchor.ns  = ns;
+  anchor.fid = fid;
+  int found = 0;
+
+  OGRGeometryH geom = OGR_F_GetGeometryRef(feature);
+  if(cacheable && geom)
+    OGR_G_GetEnvelope(geom, &anchor.envelope);
+
+  if(cacheable) {
+    pthread_mutex_lock(&cache.lock);
+    if(!cache.slots)
+      cache.slots = simplet_calloc(SIMPLET_ANCHOR_CACHE_SIZE, sizeof(*cache.slots));
+    if(cache.slots) {
+      anchor_t *cached = &cache.slots[slot(ns, fid)];
+      if((found = cached->ns == ns && cached->fid == fid
+          && same_envelope(&cached->envelope, &anchor.envelope)))
+        anchor = *cached;
+    }
+    if(found)
+      cache.hits++;
+    else
+      cache.misses++;
+    pthread_mutex_unlock(&cache.lock);
+  }
+
+  if(!found) {
+    anchor.valid = compute_anchor(geom, &anchor.x, &anchor.y);
+
+    // Bad geometries are remembered too, so they aren't measured again.
+    if(cacheable) {
+      pthread_mutex_lock(&cache.lock);
+      if(cache.slots)
+        cache.slots[slot(ns, fid)] = anchor;
+      pthread_mutex_unlock(&cache.lock);
+    }
+  }
+
+  if(!anchor.valid) return 0;
+
+  *x = anchor.x;
+  *y = anchor.y;
+  return transform ? OCTTransform(transform, 1, x, y, NULL) : 1;
+}
+
+// Drop every cached anchor and namespace.
+void
+simplet_anchor_cache_clear(){
+  pthread_mutex_lock(&cache.lock);
+  for(unsigned int i = 0; i < cache.namespaces_length; i++)
+    simplet_free(cache.namespaces[i]);
+  simplet_free(cache.namespaces);
+  simplet_free(cache.slots);
+  cache.namespaces = NULL;
+  cache.namespaces_length = 0;
+  cache.slots = NULL;
+  pthread_mutex_unlock(&cache.lock);
+}
+
+// Count the lookups of cacheable features that found their anchor, and those
+// that had to measure it, since the process started.
+void
+simplet_anchor_cache_get_counts(unsigned long *hits, unsigned long *misses){
+  pthread_mutex_lock(&cache.lock);
+  *hits   = cache.hits;
+  *misses = cache.misses;
+  pthread_mutex_unlock(&cache.lock);
+}
@@ -0,0 +1,30 @@
+#ifndef _SIMPLE_TILES_ANCHOR_H
+#define _SIMPLE_TILES_ANCHOR_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of anchors kept by default, a power of two.
+#define SIMPLET_ANCHOR_CACHE_SIZE 65536
+
+unsigned int
+simplet_anchor_namespace(const char *source, const char *sql);
+
+int
+simplet_anchor_find(unsigned int ns, OGRFeatureH feature,
+  OGRCoordinateTransformationH transform, double *x, double *y);
+
+void
+simplet_anchor_cache_clear();
+
+void
+simplet_anchor_cache_get_counts(unsigned long *hits, unsigned long *misses);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,95 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "alloc.h"
+
+// Every allocation is aligned for any of the types placed in an arena.
+#define SIMPLET_ARENA_ALIGN 16
+
+// Create and return a new arena that grows block_size bytes at a time,
+// returns NULL on failure.
+simplet_arena_t*
+simplet_arena_new(size_t block_size){
+  simplet_arena_t *arena;
+  if(!(arena = simplet_malloc(sizeof(*arena))))
+    return NULL;
+
+  memset(arena, 0, sizeof(*arena));
+  arena->block_size = block_size ? block_size : SIMPLET_ARENA_BLOCK_SIZE;
+  return arena;
+}
+
+// Free an arena and every block it holds.
+void
+simplet_arena_free(simplet_arena_t *arena){
+  simplet_arena_block_t *block = arena->head, *next;
+  while(block){
+    next = block->next;
+    simplet_free(block);
+    block = next;
+  }
+  simplet_free(arena);
+}
+
+// Allocate a block with room for at least size bytes after the header.
+static simplet_arena_block_t*
+block_new(size_t size){
+  size_t header = (sizeof(simplet_arena_block_t) + SIMPLET_ARENA_ALIGN - 1)
+    & ~(size_t) (SIMPLET_ARENA_ALIGN - 1);
+  simplet_arena_block_t *block;
+  if(!(block = simplet_malloc(header + size)))
+    return NULL;
+
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  block->data = (unsigned char *) block + header;
+  return block;
+}
+
+// Return size bytes of uninitialized memory that stay valid until the arena
+// is reset, returns NULL on failure.
+void*
+simplet_arena_alloc(simplet_arena_t *arena, size_t size){
+  size = (size + SIMPLET_ARENA_ALIGN - 1) & ~(size_t) (SIMPLET_ARENA_ALIGN - 1);
+
+  // Move on through blocks kept from earlier renders before growing.
+  simplet_arena_block_t *block = arena->current;
+  while(block && block->size - block->used < size && block->next)
+    block = block->next;
+
+  if(!block || block->size - block->used < size) {
+    simplet_arena_block_t *grown;
+    if(!(grown = block_new(size > arena->block_size ? size : arena->block_size)))
+      return NULL;
+    if(block)
+      block->next = grown;
+    else
+      arena->head = grown;
+    block = grown;
+  }
+
+  arena->current = block;
+  void *ptr = block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+// Copy str into the arena, returns NULL on failure.
+char*
+simplet_arena_strdup(simplet_arena_t *arena, const char *str){
+  size_t length = strlen(str) + 1;
+  char *copy;
+  if(!(copy = simplet_arena_alloc(arena, length)))
+    return NULL;
+  return memcpy(copy, str, length);
+}
+
+// Release everything allocated from the arena at once. Its blocks are kept
+// for later allocations.
+void
+simplet_arena_reset(simplet_arena_t *arena){
+  for(simplet_arena_block_t *block = arena->head; block; block = block->next)
+    block->used = 0;
+  arena->current = arena->head;
+}
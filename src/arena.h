@@ -0,0 +1,50 @@
+#ifndef _SIMPLE_TILES_ARENA_H
+#define _SIMPLE_TILES_ARENA_H
+
+#include <stddef.h>
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Default size of an arena block, enough for the labels of a dense tile.
+#define SIMPLET_ARENA_BLOCK_SIZE (64 * 1024)
+
+// A block of arena memory, allocations are carved off the front of data.
+typedef struct simplet_arena_block_t {
+  struct simplet_arena_block_t *next;
+  size_t size;
+  size_t used;
+  unsigned char *data;
+} simplet_arena_block_t;
+
+// A bump allocator for objects that only live as long as a single render.
+// Nothing is freed on its own, the whole arena is reset in one step and its
+// blocks are reused by the next render.
+typedef struct simplet_arena_t {
+  size_t block_size;
+  simplet_arena_block_t *head;
+  simplet_arena_block_t *current;
+} simplet_arena_t;
+
+simplet_arena_t*
+simplet_arena_new(size_t block_size);
+
+void
+simplet_arena_free(simplet_arena_t *arena);
+
+void*
+simplet_arena_alloc(simplet_arena_t *arena, size_t size);
+
+char*
+simplet_arena_strdup(simplet_arena_t *arena, const char *str);
+
+void
+simplet_arena_reset(simplet_arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
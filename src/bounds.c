@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include "math.h"
 #include "bounds.h"
+#include "alloc.h"
 
 
 // Extend the bounds to include the x, y point.
@@ -84,16 +85,12 @@ simplet_bounds_from_ogr(OGRGeometryH geom){
 // Free the memory associated with the bounds.
 void
 simplet_bounds_free(simplet_bounds_t *bounds){
-  free(bounds);
+  simplet_free(bounds);
 }
 
-// Allocate and return a new simplet_bounds_t.
-simplet_bounds_t*
-simplet_bounds_new(){
-  simplet_bounds_t *bounds;
-  if(!(bounds = malloc(sizeof(*bounds))))
-    return NULL;
-
+// Reset bounds so the first call to simplet_bounds_extend sets its extent.
+void
+simplet_bounds_init(simplet_bounds_t *bounds){
   memset(bounds, 0, sizeof(*bounds));
 
   // Set the bounds to be as big as the universe.
@@ -101,21 +98,41 @@ simplet_bounds_new(){
   bounds->nw.y = -INFINITY;
   bounds->se.x = -INFINITY;
   bounds->se.y = INFINITY;
+}
+
+// Allocate and return a new simplet_bounds_t.
+simplet_bounds_t*
+simplet_bounds_new(){
+  simplet_bounds_t *bounds;
+  if(!(bounds = simplet_malloc(sizeof(*bounds))))
+    return NULL;
+
+  simplet_bounds_init(bounds);
 
   return bounds;
 }
 
+// Write bounds as Well Known Text to str, returns the length of the text as
+// snprintf does.
+static int
+format_wkt(char *str, size_t size, simplet_bounds_t *bounds){
+  return snprintf(str, size, "POLYGON ((%f %f, %f %f, %f %f, %f %f, %f %f))",
+    bounds->se.x, bounds->nw.y,
+    bounds->se.x, bounds->se.y,
+    bounds->nw.x, bounds->se.y,
+    bounds->nw.x, bounds->nw.y,
+    bounds->se.x, bounds->nw.y);
+}
+
 // Convert a bounds to a Well Known Text string and store it in **wkt
 simplet_status_t
 simplet_bounds_to_wkt(simplet_bounds_t *bounds, char **wkt){
-  int ret = asprintf(wkt, "POLYGON ((%f %f, %f %f, %f %f, %f %f, %f %f))",
-                  bounds->se.x, bounds->nw.y,
-                  bounds->se.x, bounds->se.y,
-                  bounds->nw.x, bounds->se.y,
-                  bounds->nw.x, bounds->nw.y,
-                  bounds->se.x, bounds->nw.y);
-  if(ret > -1) return SIMPLET_OK;
-  return SIMPLET_ERR;
+  // Measure the string first so it can come from simplet_malloc.
+  int length = format_wkt(NULL, 0, bounds);
+  if(length < 0 || !(*wkt = simplet_malloc(length + 1)))
+    return SIMPLET_ERR;
+  format_wkt(*wkt, length + 1, bounds);
+  return SIMPLET_OK;
 }
 
 simplet_bounds_t*
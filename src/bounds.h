@@ -12,6 +12,9 @@ extern "C" {
 simplet_bounds_t*
 simplet_bounds_new();
 
+void
+simplet_bounds_init(simplet_bounds_t *bounds);
+
 void
 simplet_bounds_extend(simplet_bounds_t *bounds, double x, double y);
 
@@ -0,0 +1,286 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "expr.h"
+#include "util.h"
+#include "alloc.h"
+
+// Style expressions let a style value depend on a field of the feature being
+// drawn, so one filter can render a whole choropleth:
+//
+//     match(TYPE, park:#00ff00, water:#0000ff, #cccccc)
+//     step(POP_EST, #eeeeee, 1000000:#aaaaaa, 10000000:#666666)
+//     interpolate(POP_EST, 0:0.5, 10000000:3)
+//
+// Values are either numbers or #xxxxxx[aa] colors. A trailing value without
+// a key in match, or a leading one in step, is used when nothing else
+// applies.
+
+// Trim whitespace from both ends of the span [*start, *end).
+static void
+trim(const char **start, const char **end){
+  while(*start < *end && isspace((unsigned char) **start)) (*start)++;
+  while(*end > *start && isspace((unsigned char) *(*end - 1))) (*end)--;
+}
+
+// Copy the span [start, end) into a new string, stripping matching quotes.
+static char*
+copy_span(const char *start, const char *end){
+  trim(&start, &end);
+  if(end - start >= 2 && (*start == '\'' || *start == '"') && *(end - 1) == *start){
+    start++;
+    end--;
+  }
+
+  char *str;
+  if(!(str = simplet_malloc(end - start + 1)))
+    return NULL;
+  memcpy(str, start, end - start);
+  str[end - start] = '\0';
+  return str;
+}
+
+// Parse a number or a color in the span [start, end) into value.
+static int
+parse_value(const char *start, const char *end, double value[4]){
+  char *str, *rest;
+  if(!(str = copy_span(start, end)))
+    return 0;
+
+  int ok = 0;
+  if(*str == '#') {
+    unsigned int r, g, b, a;
+    int count = simplet_parse_color(str, &r, &g, &b, &a);
+    if(count == 3 || count == 4) {
+      value[0] = r / SIMPLET_CCEIL;
+      value[1] = g / SIMPLET_CCEIL;
+      value[2] = b / SIMPLET_CCEIL;
+      value[3] = count == 4 ? a / SIMPLET_CCEIL : 1.0;
+      ok = 1;
+    }
+  } else {
+    value[0] = strtod(str, &rest);
+    value[1] = value[2] = value[3] = 0;
+    ok = rest != str && *rest == '\0';
+  }
+
+  simplet_free(str);
+  return ok;
+}
+
+// Parse one comma separated entry of an expression. Entries are either
+// `key:value` stops or a bare value.
+static int
+parse_entry(simplet_expr_t *expr, const char *start, const char *end){
+  const char *colon = NULL;
+  for(const char *c = start; c < end; c++)
+    if(*c == ':') colon = c;
+
+  // A bare value is the fallback.
+  if(!colon) {
+    if(expr->has_fallback || expr->type == SIMPLET_EXPR_INTERPOLATE)
+      return 0;
+    if(expr->type == SIMPLET_EXPR_STEP && expr->length)
+      return 0;
+    expr->has_fallback = 1;
+    return parse_value(start, end, expr->fallback);
+  }
+
+  // A match fallback has to come last.
+  if(expr->type == SIMPLET_EXPR_MATCH && expr->has_fallback)
+    return 0;
+
+  simplet_expr_stop_t *stops;
+  if(!(stops = simplet_realloc(expr->stops, sizeof(*stops) * (expr->length + 1))))
+    return 0;
+  expr->stops = stops;
+
+  simplet_expr_stop_t *stop = &expr->stops[expr->length];
+  memset(stop, 0, sizeof(*stop));
+  expr->length++;
+
+  if(!parse_value(colon + 1, end, stop->value))
+    return 0;
+
+  char *input, *rest;
+  if(expr->type == SIMPLET_EXPR_MATCH) {
+    if(!(stop->key = copy_span(start, colon)))
+      return 0;
+    stop->input   = strtod(stop->key, &rest);
+    stop->numeric = rest != stop->key && *rest == '\0';
+    return 1;
+  }
+
+  if(!(input = copy_span(start, colon)))
+    return 0;
+  stop->input = strtod(input, &rest);
+  int ok = rest != input && *rest == '\0';
+  simplet_free(input);
+
+  // Stops must be in ascending order.
+  if(ok && expr->length > 1 && stop->input < expr->stops[expr->length - 2].input)
+    return 0;
+  return ok;
+}
+
+// Parse arg into a new expression. Returns NULL if arg isn't an expression
+// or is malformed, in which case it should be treated as a plain value.
+simplet_expr_t*
+simplet_expr_new(const char *arg){
+  simplet_expr_type_t type;
+  const char *start = arg, *end = arg + strlen(arg);
+  trim(&start, &end);
+
+  if(!strncmp(start, "match(", 6))
+    type = SIMPLET_EXPR_MATCH;
+  else if(!strncmp(start, "step(", 5))
+    type = SIMPLET_EXPR_STEP;
+  else if(!strncmp(start, "interpolate(", 12))
+    type = SIMPLET_EXPR_INTERPOLATE;
+  else
+    return NULL;
+
+  // The expression has to end with its closing paren.
+  const char *open = strchr(start, '('), *close = end - 1;
+  if(close <= open || *close != ')')
+    return NULL;
+
+  simplet_expr_t *expr;
+  if(!(expr = simplet_malloc(sizeof(*expr))))
+    return NULL;
+  memset(expr, 0, sizeof(*expr));
+  expr->type = type;
+
+  // The first entry names the field, the rest are stops.
+  const char *entry = open + 1;
+  for(const char *c = entry; c <= close; c++){
+    if(*c != ',' && c != close)
+      continue;
+
+    int ok;
+    if(!expr->field)
+      ok = (expr->field = copy_span(entry, c)) != NULL && *expr->field;
+    else
+      ok = parse_entry(expr, entry, c);
+
+    if(!ok) {
+      simplet_expr_free(expr);
+      return NULL;
+    }
+    entry = c + 1;
+  }
+
+  if(!expr->length) {
+    simplet_expr_free(expr);
+    return NULL;
+  }
+
+  return expr;
+}
+
+// Free an expression and its stops.
+void
+simplet_expr_free(simplet_expr_t *expr){
+  for(unsigned int i = 0; i < expr->length; i++)
+    simplet_free(expr->stops[i].key);
+  simplet_free(expr->stops);
+  simplet_free(expr->field);
+  simplet_free(expr);
+}
+
+// Store the fallback in value if there is one.
+static int
+fallback(simplet_expr_t *expr, double value[4]){
+  if(!expr->has_fallback)
+    return 0;
+  memcpy(value, expr->fallback, sizeof(expr->fallback));
+  return 1;
+}
+
+// Evaluate a match expression against a string input. Numeric expressions
+// are evaluated against the number in input. Returns 0 if there is no value.
+int
+simplet_expr_eval_string(simplet_expr_t *expr, const char *input, double value[4]){
+  if(expr->type != SIMPLET_EXPR_MATCH)
+    return simplet_expr_eval_number(expr, strtod(input, NULL), value);
+
+  for(unsigned int i = 0; i < expr->length; i++){
+    if(!strcmp(expr->stops[i].key, input)) {
+      memcpy(value, expr->stops[i].value, sizeof(expr->stops[i].value));
+      return 1;
+    }
+  }
+  return fallback(expr, value);
+}
+
+// Evaluate a step or interpolate expression against a numeric input. Returns
+// 0 if there is no value. NaN, from a NaN field or the string "nan", isn't
+// ordered against any stop and only gets the fallback.
+int
+simplet_expr_eval_number(simplet_expr_t *expr, double input, double value[4]){
+  simplet_expr_stop_t *stops = expr->stops;
+  unsigned int last = expr->length - 1;
+  if(isnan(input))
+    return fallback(expr, value);
+
+  switch(expr->type){
+    case SIMPLET_EXPR_MATCH:
+      for(unsigned int i = 0; i < expr->length; i++){
+        if(stops[i].numeric && stops[i].input == input) {
+          memcpy(value, stops[i].value, sizeof(stops[i].value));
+          return 1;
+        }
+      }
+      return fallback(expr, value);
+
+    case SIMPLET_EXPR_STEP:
+      if(input < stops[0].input)
+        return fallback(expr, value);
+      for(unsigned int i = last + 1; i-- > 0;){
+        if(input >= stops[i].input) {
+          memcpy(value, stops[i].value, sizeof(stops[i].value));
+          return 1;
+        }
+      }
+      return fallback(expr, value);
+
+    case SIMPLET_EXPR_INTERPOLATE:
+      if(input <= stops[0].input) {
+        memcpy(value, stops[0].value, sizeof(stops[0].value));
+        return 1;
+      }
+      if(input >= stops[last].input) {
+        memcpy(value, stops[last].value, sizeof(stops[last].value));
+        return 1;
+      }
+      for(unsigned int i = 1; i <= last; i++){
+        if(input > stops[i].input)
+          continue;
+        double span = stops[i].input - stops[i - 1].input;
+        double t = span > 0 ? (input - stops[i - 1].input) / span : 1;
+        for(int j = 0; j < 4; j++)
+          value[j] = stops[i - 1].value[j] + t * (stops[i].value[j] - stops[i - 1].value[j]);
+        return 1;
+      }
+  }
+  return 0;
+}
+
+// Evaluate an expression for a feature using the field at index field, which
+// is looked up once per query. Unset fields only get the fallback. Numeric
+// fields are matched by value, OGR formats a Real 1 as "1.000000000000000".
+int
+simplet_expr_eval(simplet_expr_t *expr, OGRFeatureH feature, int field, double value[4]){
+  if(field < 0 || !OGR_F_IsFieldSet(feature, field))
+    return fallback(expr, value);
+
+  if(expr->type == SIMPLET_EXPR_MATCH) {
+    OGRFieldType type = OGR_Fld_GetType(OGR_F_GetFieldDefnRef(feature, field));
+    if(type != OFTInteger && type != OFTInteger64 && type != OFTReal)
+      return simplet_expr_eval_string(expr, OGR_F_GetFieldAsString(feature, field), value);
+  }
+
+  return simplet_expr_eval_number(expr, OGR_F_GetFieldAsDouble(feature, field), value);
+}
@@ -0,0 +1,29 @@
+#ifndef _SIMPLE_TILES_EXPR_H
+#define _SIMPLE_TILES_EXPR_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+simplet_expr_t*
+simplet_expr_new(const char *arg);
+
+void
+simplet_expr_free(simplet_expr_t *expr);
+
+int
+simplet_expr_eval_string(simplet_expr_t *expr, const char *input, double value[4]);
+
+int
+simplet_expr_eval_number(simplet_expr_t *expr, double input, double value[4]);
+
+int
+simplet_expr_eval(simplet_expr_t *expr, OGRFeatureH feature, int field, double value[4]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
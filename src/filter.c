@@ -9,6 +9,12 @@
 #include "bounds.h"
 #include "text.h"
 #include "error.h"
+#include "render.h"
+#include "labels.h"
+#include "anchor.h"
+#include "alloc.h"
+#include "trace.h"
+#include "probes.h"
 
 // Set up some user data functions.
 SIMPLET_HAS_USER_DATA(filter)
@@ -17,18 +23,19 @@ SIMPLET_HAS_USER_DATA(filter)
 simplet_filter_t *
 simplet_filter_new(const char *sqlquery){
   simplet_filter_t *filter;
-  if(!(filter = malloc(sizeof(*filter))))
+  if(!(filter = simplet_malloc(sizeof(*filter))))
     return NULL;
 
   memset(filter, 0, sizeof(*filter));
 
   if(!(filter->styles = simplet_list_new())){
-    free(filter);
+    simplet_free(filter);
     return NULL;
   }
 
   filter->error.status = SIMPLET_OK;
   filter->ogrsql       = simplet_copy_string(sqlquery);
+  filter->max_zoom     = SIMPLET_MAX_ZOOM;
   return filter;
 }
 
@@ -45,8 +52,8 @@ simplet_filter_free(simplet_filter_t *filter){
   simplet_list_t* styles = filter->styles;
   simplet_list_set_item_free(styles, simplet_style_vfree);
   simplet_list_free(styles);
-  free(filter->ogrsql);
-  free(filter);
+  simplet_free(filter->ogrsql);
+  simplet_free(filter);
 }
 
 // Add an error function.
@@ -55,7 +62,7 @@ SIMPLET_ERROR_FUNC(filter_t)
 // Set the OGR SQL query on this filter.
 simplet_status_t
 simplet_filter_set_query(simplet_filter_t *filter, const char* query){
-  free(filter->ogrsql);
+  simplet_free(filter->ogrsql);
   if(!(filter->ogrsql = simplet_copy_string(query)))
     return set_error(filter, SIMPLET_OOM, "Out of memory setting filter query");
   return SIMPLET_OK;
@@ -71,19 +78,115 @@ simplet_filter_get_query(simplet_filter_t *filter, char** query){
   return SIMPLET_OK;
 }
 
-// Plot a part of a geometry on the ctx.
+// Restrict the filter to zoom levels min through max inclusive.
+void
+simplet_filter_set_zoom_range(simplet_filter_t *filter, unsigned int min, unsigned int max){
+  filter->min_zoom = min;
+  filter->max_zoom = max;
+}
+
+// Check if the filter is drawn at zoom, an unknown zoom of -1 is always drawn.
+int
+simplet_filter_is_visible(simplet_filter_t *filter, int zoom){
+  if(zoom < 0) return 1;
+  return (unsigned int) zoom >= filter->min_zoom && (unsigned int) zoom <= filter->max_zoom;
+}
+
+// Geometries aren't styled one at a time. They are appended to a single
+// path that is filled and stroked once, which turns thousands of
+// rasterization calls per tile into a handful. The pending path is drawn when
+// the next geometry needs different styles (lines aren't filled, data driven
+// styles may change per feature), when the filter is done, and once it holds
+// SIMPLET_MAX_PATH_POINTS points so path memory stays bounded.
+//
+// This changes the output from drawing features one at a time: every fill in
+// the path is drawn before any of its strokes, so a stroke is no longer
+// covered by the fills of later features, and overlapping translucent
+// features are filled as their union rather than darkening where they
+// overlap.
+//
+// For seamless filters this is also what removes the seams: cairo computes
+// coverage for the union of every polygon in the path, so edges shared by
+// two polygons are fully covered and only the outer boundary is antialiased.
+// Splitting the path would bring back a seam along the split, so seamless
+// paths get the far larger SIMPLET_MAX_SEAMLESS_POINTS, which still bounds
+// their memory on huge datasets.
+#define SIMPLET_MAX_PATH_POINTS 50000
+#define SIMPLET_MAX_SEAMLESS_POINTS 2000000
+
+typedef struct {
+  cairo_t *ctx;
+  simplet_compiled_styles_t styles; // the styles the pending path is drawn with
+  unsigned int mask;                // which of them apply, 0 if nothing is pending
+  unsigned int points;
+  simplet_stats_t *stats;
+} batch_t;
+
+// Draw the pending path and clear it.
+static void
+flush_path(batch_t *batch){
+  if(!batch->mask)
+    return;
+
+  cairo_save(batch->ctx);
+  simplet_apply_compiled_styles(batch->ctx, &batch->styles, batch->mask);
+  cairo_restore(batch->ctx);
+  cairo_new_path(batch->ctx);
+  batch->stats->vertices_emitted += batch->points;
+  batch->mask   = 0;
+  batch->points = 0;
+}
+
+// Make sure the pending path can take a geometry drawn with mask and styles,
+// drawing it first if it can't.
 static void
-plot_part(OGRGeometryH geom, simplet_filter_t *filter, cairo_t *ctx){
-  // Look up whether we should be rendering a seamless path, if so we won't
-  // simplify the points to protect against holes.
-  simplet_style_t *seamless = simplet_lookup_style(filter->styles, "seamless");
+begin_path(batch_t *batch, simplet_compiled_styles_t *styles, unsigned int mask){
+  int seamless = styles->set & SIMPLET_STYLE_SEAMLESS;
+  if(batch->mask == mask
+    && batch->points < (seamless ? SIMPLET_MAX_SEAMLESS_POINTS : SIMPLET_MAX_PATH_POINTS)
+    && (!styles->bindings_length || simplet_compiled_styles_equal(&batch->styles, styles)))
+    return;
+
+  flush_path(batch);
+  batch->styles = *styles;
+  batch->mask   = mask;
+}
+
+// Twice the signed area of a ring, positive when it runs counterclockwise.
+static double
+signed_area(OGRGeometryH geom){
+  int count = OGR_G_GetPointCount(geom);
+  double area = 0, x, y, last_x, last_y;
+  if(count < 3)
+    return 0;
+
+  OGR_G_GetPoint(geom, count - 1, &last_x, &last_y, NULL);
+  for(int i = 0; i < count; i++){
+    OGR_G_GetPoint(geom, i, &x, &y, NULL);
+    area += last_x * y - x * last_y;
+    last_x = x;
+    last_y = y;
+  }
+  return area;
+}
+
+// Plot a part of a geometry on the ctx, walking its points backwards if
+// reverse is set.
+static void
+plot_part(OGRGeometryH geom, batch_t *batch, int reverse){
+  // If we are rendering a seamless path we won't simplify the points to
+  // protect against holes.
+  int seamless = batch->styles.set & SIMPLET_STYLE_SEAMLESS;
+  cairo_t *ctx = batch->ctx;
+  int count = OGR_G_GetPointCount(geom);
   double x, y, last_x, last_y;
-  OGR_G_GetPoint(geom, 0, &x, &y, NULL);
+  OGR_G_GetPoint(geom, reverse ? count - 1 : 0, &x, &y, NULL);
   last_x = x;
   last_y = y;
   cairo_move_to(ctx, x, y);
-  for(int j = 0; j < OGR_G_GetPointCount(geom); j++){
-    OGR_G_GetPoint(geom, j, &x, &y, NULL);
+  batch->stats->vertices_read += count;
+  for(int j = 0; j < count; j++){
+    OGR_G_GetPoint(geom, reverse ? count - 1 - j : j, &x, &y, NULL);
     double dx = last_x - x;
     double dy = last_y - y;
     cairo_user_to_device_distance(ctx, &dx, &dy);
@@ -93,18 +196,24 @@ plot_part(OGRGeometryH geom, simplet_filter_t *filter, cairo_t *ctx){
       cairo_line_to(ctx, x, y);
       last_x = x;
       last_y = y;
+      batch->points++;
     }
   }
   // Ensure something is always drawn, might not be necessary.
-  OGR_G_GetPoint(geom, OGR_G_GetPointCount(geom) - 1, &x, &y, NULL);
+  OGR_G_GetPoint(geom, reverse ? 0 : count - 1, &x, &y, NULL);
   cairo_line_to(ctx, x, y);
+  batch->points++;
 }
 
 // Plot a polygon.
+//
+// The pending path holds many features and is filled with the nonzero
+// winding rule, so ring direction matters: an outer ring of one feature
+// drawn against the direction of an overlapping one would cut a hole in
+// both. Outer rings are always emitted counterclockwise and holes
+// clockwise, whatever their order in the source.
 static void
-plot_polygon(OGRGeometryH geom, simplet_filter_t *filter, cairo_t *ctx){
-  cairo_save(ctx);
-  cairo_new_path(ctx);
+plot_polygon(OGRGeometryH geom, batch_t *batch){
   //  Split the polygon into sub polygons.
   for(int i = 0; i < OGR_G_GetGeometryCount(geom); i++){
     OGRGeometryH subgeom = OGR_G_GetGeometryRef(geom, i);
@@ -113,74 +222,53 @@ plot_polygon(OGRGeometryH geom, simplet_filter_t *filter, cairo_t *ctx){
 
     // If the sub polygon has more child polygons recurse.
     if(OGR_G_GetGeometryCount(subgeom) > 0) {
-      plot_polygon(subgeom, filter, ctx);
+      plot_polygon(subgeom, batch);
       continue;
     }
 
-    // Otherwise, plot the sub polygon.
-    plot_part(subgeom, filter, ctx);
-    cairo_close_path(ctx);
+    // Otherwise, plot the ring. The first one is the outer ring.
+    double area = signed_area(subgeom);
+    plot_part(subgeom, batch, i == 0 ? area < 0 : area > 0);
+    cairo_close_path(batch->ctx);
   }
-  cairo_close_path(ctx);
-
-  // Apply the styles to the current path.
-  simplet_apply_styles(ctx, filter->styles,
-                       "line-join", "line-cap", "weight", "fill", "stroke", NULL);
-  cairo_clip(ctx);
-  cairo_restore(ctx);
 }
 
 // Plot a point as a circle on the path.
 static void
-plot_point(OGRGeometryH geom, simplet_filter_t *filter, cairo_t *ctx){
-	cairo_save(ctx);
-  double x, y;
-
-  simplet_style_t *style = simplet_lookup_style(filter->styles, "radius");
-  if(style == NULL)
-    return;
-
-  double r = strtod(style->arg, NULL), dy = 0;
+plot_point(OGRGeometryH geom, batch_t *batch){
+  cairo_t *ctx = batch->ctx;
+  double x, y, r = batch->styles.radius, dy = 0;
 
   // Loop through the points in the geom and place them on the ctx.
   cairo_device_to_user_distance(ctx, &r, &dy);
+  batch->stats->vertices_read += OGR_G_GetPointCount(geom);
   for(int i = 0; i < OGR_G_GetPointCount(geom); i++){
     OGR_G_GetPoint(geom, i, &x, &y, NULL);
-    cairo_new_path(ctx);
+    cairo_new_sub_path(ctx);
     cairo_arc(ctx, x - r / 2, y - r / 2, r, 0., 2 * SIMPLET_PI);
     cairo_close_path(ctx);
+    batch->points++;
   }
-  // Apply some styles.
-  simplet_apply_styles(ctx, filter->styles,
-                       "line-join", "line-cap", "weight", "fill", "stroke", NULL);
-  cairo_restore(ctx);
-}
-
-// Plot a linestring.
-static void
-plot_line(OGRGeometryH geom, simplet_filter_t *filter, cairo_t *ctx){
-  cairo_save(ctx);
-  cairo_new_path(ctx);
-  plot_part(geom, filter, ctx);
-  simplet_apply_styles(ctx, filter->styles,
-                        "line-join", "line-cap", "weight", "stroke", NULL);
-  cairo_close_path(ctx);
-  cairo_restore(ctx);
 }
 
 // Dispatch to the individual functions for rendering based on geometry type.
 static void
-dispatch(OGRGeometryH geom, simplet_filter_t *filter, cairo_t *ctx){
+dispatch(OGRGeometryH geom, simplet_compiled_styles_t *styles, batch_t *batch){
   switch(wkbFlatten(OGR_G_GetGeometryType(geom))) {
     case wkbPolygon:
-      plot_polygon(geom, filter, ctx);
+      begin_path(batch, styles, SIMPLET_STYLE_POLYGON);
+      plot_polygon(geom, batch);
       break;
     case wkbLinearRing:
     case wkbLineString:
-      plot_line(geom, filter, ctx);
+      begin_path(batch, styles, SIMPLET_STYLE_LINE);
+      plot_part(geom, batch, 0);
       break;
     case wkbPoint:
-      plot_point(geom, filter, ctx);
+      if(!(styles->set & SIMPLET_STYLE_RADIUS))
+        break;
+      begin_path(batch, styles, SIMPLET_STYLE_POLYGON);
+      plot_point(geom, batch);
       break;
 
     // For geometry collections, recurse into the individual members and
@@ -193,7 +281,7 @@ dispatch(OGRGeometryH geom, simplet_filter_t *filter, cairo_t *ctx){
         OGRGeometryH subgeom = OGR_G_GetGeometryRef(geom, i);
         if(subgeom == NULL)
           continue;
-        dispatch(subgeom, filter, ctx);
+        dispatch(subgeom, styles, batch);
       }
       break;
     default:
@@ -201,28 +289,49 @@ dispatch(OGRGeometryH geom, simplet_filter_t *filter, cairo_t *ctx){
   }
 }
 
-// Saturate the canvas for seamless shapes.
+// Add the time since *mark to *total and move the mark up to now.
 static void
-set_seamless(simplet_list_t *styles, cairo_t *ctx){
-  if(simplet_lookup_style(styles, "seamless"))
-    cairo_set_operator(ctx, CAIRO_OPERATOR_SATURATE);
+lap(double *mark, double *total){
+  double now = simplet_time_now();
+  *total += now - *mark;
+  *mark = now;
+}
+
+// Draw the labels placed ahead of time for the filter when its query has
+// nothing to draw this render, they were placed from the whole zoom level
+// and may still reach into this tile.
+static simplet_status_t
+apply_placed_labels(simplet_filter_t *filter, simplet_render_t *render,
+  simplet_lithograph_t *litho){
+  if(!render->labels)
+    return SIMPLET_OK;
+
+  simplet_compiled_styles_t styles;
+  simplet_compile_styles(filter->styles, &styles);
+  simplet_labels_apply(render->labels, filter, render, litho->ctx, &styles);
+  simplet_release_compiled_styles(&styles);
+  return SIMPLET_OK;
 }
 
 // This is the meat of rendering. In this function, we hit the actual data
 // sources, perform transformation, add labels to the lithograph,
 // and plot the individual geometries.
-simplet_status_t
-simplet_filter_process(simplet_filter_t *filter, simplet_map_t *map,
+static simplet_status_t
+process(simplet_filter_t *filter, simplet_render_t *render,
   OGRDataSourceH source, simplet_lithograph_t *litho, cairo_t *ctx){
+  simplet_stats_t *stats = &render->stats;
+  double mark = simplet_time_now();
+  double query_start = simplet_trace_begin();
+  SIMPLET_PROBE2(query__start, render->zoom, filter->ogrsql);
 
   // Grab a layer in order to suss out the srs
   OGRLayerH olayer;
   if(!(olayer = OGR_DS_ExecuteSQL(source, filter->ogrsql, NULL, NULL))){
     int err = CPLGetLastErrorNo();
     if(!err)
-      return SIMPLET_OK;
+      return apply_placed_labels(filter, render, litho);
     else
-      return set_error(filter, SIMPLET_OGR_ERR, CPLGetLastErrorMsg());
+      return simplet_render_set_error(render, SIMPLET_OGR_ERR, CPLGetLastErrorMsg());
   }
 
   // Try and figure out the srs.
@@ -231,31 +340,29 @@ simplet_filter_process(simplet_filter_t *filter, simplet_map_t *map,
     OGR_DS_ReleaseResultSet(source, olayer);
     int err = CPLGetLastErrorNo();
     if(!err)
-      return SIMPLET_OK;
+      return apply_placed_labels(filter, render, litho);
     else
-      return set_error(filter, SIMPLET_OGR_ERR, CPLGetLastErrorMsg());
+      return simplet_render_set_error(render, SIMPLET_OGR_ERR, CPLGetLastErrorMsg());
   }
 
   // If the map has a buffer we need to grow the bounds a bit to grab more
   // data from the data source.
   OGRGeometryH bounds;
-  if(simplet_map_get_buffer(map) > 0) {
+  if(simplet_map_get_buffer(render->map) > 0) {
     cairo_matrix_t mat;
-    simplet_map_init_matrix(map, &mat);
+    simplet_render_init_matrix(render, &mat);
     cairo_matrix_invert(&mat);
     double dx, dy;
-    dx = dy = simplet_map_get_buffer(map);
+    dx = dy = simplet_map_get_buffer(render->map);
     cairo_matrix_transform_distance(&mat, &dx, &dy);
 
-    simplet_bounds_t *bbounds = simplet_bounds_buffer(map->bounds, dx);
-    if(!bbounds) {
-      OGR_DS_ReleaseResultSet(source, olayer);
-      return SIMPLET_OGR_ERR;
-    }
-    bounds = simplet_bounds_to_ogr(bbounds, map->proj);
-    free(bbounds);
+    // Grow a copy of the bounds on the stack, so there's nothing to free.
+    simplet_bounds_t bbounds = render->bounds;
+    simplet_bounds_extend(&bbounds, render->bounds.nw.x - dx, render->bounds.nw.y + dx);
+    simplet_bounds_extend(&bbounds, render->bounds.se.x + dx, render->bounds.se.y - dx);
+    bounds = simplet_bounds_to_ogr(&bbounds, render->proj);
   } else {
-    bounds = simplet_bounds_to_ogr(map->bounds, map->proj);
+    bounds = simplet_bounds_to_ogr(&render->bounds, render->proj);
   }
 
   // Transform the OGR bounds to the sources srs.
@@ -266,55 +373,133 @@ simplet_filter_process(simplet_filter_t *filter, simplet_map_t *map,
   olayer = OGR_DS_ExecuteSQL(source, filter->ogrsql, bounds, NULL);
   OGR_G_DestroyGeometry(bounds);
   if(!olayer)
-    return set_error(filter, SIMPLET_OGR_ERR, CPLGetLastErrorMsg());
+    return simplet_render_set_error(render, SIMPLET_OGR_ERR, CPLGetLastErrorMsg());
+  lap(&mark, &stats->query_time);
+  simplet_trace_end(render, "filter", "query", filter->ogrsql, query_start);
+  SIMPLET_PROBE2(query__done, render->zoom, filter->ogrsql);
+  stats->queries++;
 
   // Create a transorm to use in rendering later.
   OGRCoordinateTransformationH transform;
-  if(!(transform = OCTNewCoordinateTransformation(srs, map->proj)))
-    return set_error(filter, SIMPLET_OGR_ERR, CPLGetLastErrorMsg());
+  if(!(transform = OCTNewCoordinateTransformation(srs, render->proj)))
+    return simplet_render_set_error(render, SIMPLET_OGR_ERR, CPLGetLastErrorMsg());
 
   // Copy the original surface so we don't muss about with defaults.
   cairo_surface_t *surface = cairo_surface_create_similar(cairo_get_target(ctx),
-                                  CAIRO_CONTENT_COLOR_ALPHA, map->width, map->height);
+                                  CAIRO_CONTENT_COLOR_ALPHA, render->width, render->height);
   if(cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
-    return set_error(filter, SIMPLET_CAIRO_ERR, (const char *)cairo_status_to_string(cairo_surface_status(surface)));
+    return simplet_render_set_error(render, SIMPLET_CAIRO_ERR, (const char *)cairo_status_to_string(cairo_surface_status(surface)));
 
-  // Setup seamless rendering.
   cairo_t *sub_ctx = cairo_create(surface);
-  set_seamless(filter->styles, sub_ctx);
 
   // Initialize the transformation matrix.
   cairo_matrix_t mat;
-  simplet_map_init_matrix(map, &mat);
+  simplet_render_init_matrix(render, &mat);
   cairo_set_matrix(sub_ctx, &mat);
 
-  // Loop through and place the features.
+  // Parse the styles once rather than for every feature, and look up the
+  // fields any data driven styles depend on.
+  simplet_compiled_styles_t styles, resolved;
+  simplet_compile_styles(filter->styles, &styles);
+  simplet_bind_compiled_styles(&styles, OGR_L_GetLayerDefn(olayer));
+
+  batch_t batch;
+  memset(&batch, 0, sizeof(batch));
+  batch.ctx   = sub_ctx;
+  batch.stats = stats;
+
+  // Labels placed ahead of time for this zoom don't need to be placed again.
+  int label = (styles.set & SIMPLET_STYLE_TEXT_FIELD) && !render->labels;
+  unsigned int anchors = label ? simplet_anchor_namespace(OGR_DS_GetName(source), filter->ogrsql) : 0;
+
+  // Loop through and place the features. Time spent is split into stages as
+  // it goes, fetching a feature counts as part of the query.
   OGRFeatureH feature;
+  lap(&mark, &stats->plot_time);
   while((feature = OGR_L_GetNextFeature(olayer))){
+    lap(&mark, &stats->query_time);
+    stats->features_read++;
     OGRGeometryH geom = OGR_F_GetGeometryRef(feature);
 
+    // Find the label anchor while the geometry is still in the projection of
+    // the source, which is what anchors are cached in. Once the filter has
+    // placed all the labels it may, the rest aren't looked at.
+    double x, y;
+    int anchored = label && !simplet_lithograph_is_full(litho, &styles)
+      && simplet_anchor_find(anchors, feature, transform, &x, &y);
+    if(label) lap(&mark, &stats->label_time);
+
     if(geom == NULL || OGR_G_Transform(geom, transform) != OGRERR_NONE){
+      stats->features_skipped++;
       OGR_F_Destroy(feature);
+      lap(&mark, &stats->transform_time);
       continue;
     }
+    lap(&mark, &stats->transform_time);
 
-    dispatch(geom, filter, sub_ctx);
+    // Evaluate data driven styles for this feature.
+    simplet_compiled_styles_t *feature_styles = &styles;
+    if(styles.bindings_length) {
+      simplet_resolve_compiled_styles(&styles, feature, &resolved);
+      feature_styles = &resolved;
+    }
+
+    SIMPLET_PROBE2(feature__dispatch, render->zoom, OGR_G_GetGeometryType(geom));
+    dispatch(geom, feature_styles, &batch);
+    lap(&mark, &stats->plot_time);
 
-    // Add feature labels, this is another loop, but it should be fast enough/
-    simplet_lithograph_add_placement(litho, feature, filter->styles, sub_ctx);
+    // Add feature labels, this is another loop, but it should be fast enough.
+    if(anchored) {
+      simplet_lithograph_add_placement(litho, feature, &styles, sub_ctx, x, y);
+      lap(&mark, &stats->label_time);
+    }
     OGR_F_Destroy(feature);
   }
+  lap(&mark, &stats->query_time);
+
+  // Draw whatever is left of the path.
+  flush_path(&batch);
+  lap(&mark, &stats->plot_time);
 
   // Cleanup.
   cairo_set_source_surface(ctx, surface, 0, 0);
   cairo_paint(ctx);
   cairo_destroy(sub_ctx);
   cairo_surface_destroy(surface);
+  lap(&mark, &stats->composite_time);
   OGR_DS_ReleaseResultSet(source, olayer);
   OCTDestroyCoordinateTransformation(transform);
+  lap(&mark, &stats->query_time);
+
+  // Draw the labels this filter placed.
+  double label_start = simplet_trace_begin();
+  if(render->labels)
+    simplet_labels_apply(render->labels, filter, render, litho->ctx, &styles);
+  else
+    simplet_lithograph_apply(litho, &styles);
+  lap(&mark, &stats->label_time);
+  simplet_trace_end(render, "filter", "labels", NULL, label_start);
+  simplet_release_compiled_styles(&styles);
+
+  if(litho->error.status != SIMPLET_OK)
+    return simplet_render_set_error(render, litho->error.status, litho->error.msg);
   return SIMPLET_OK;
 }
 
+// Run the filter's query and draw what it returns.
+simplet_status_t
+simplet_filter_process(simplet_filter_t *filter, simplet_render_t *render,
+  OGRDataSourceH source, simplet_lithograph_t *litho, cairo_t *ctx){
+  // Don't run any queries for filters that aren't drawn at this zoom.
+  if(!simplet_filter_is_visible(filter, render->zoom))
+    return SIMPLET_OK;
+
+  double start = simplet_trace_begin();
+  simplet_status_t status = process(filter, render, source, litho, ctx);
+  simplet_trace_end(render, "filter", "filter", filter->ogrsql, start);
+  return status;
+}
+
 // Initialize and add a new style to this filter.
 simplet_style_t*
 simplet_filter_add_style(simplet_filter_t *filter, const char *key, const char *arg){
@@ -34,8 +34,14 @@ simplet_filter_add_style(simplet_filter_t *filter, const char *key, const char *
 simplet_style_t*
 simplet_filter_add_style_directly(simplet_filter_t *filter, simplet_style_t *style);
 
+void
+simplet_filter_set_zoom_range(simplet_filter_t *filter, unsigned int min, unsigned int max);
+
+int
+simplet_filter_is_visible(simplet_filter_t *filter, int zoom);
+
 simplet_status_t
-simplet_filter_process(simplet_filter_t *filter, simplet_map_t *map,
+simplet_filter_process(simplet_filter_t *filter, simplet_render_t *render,
   OGRDataSourceH source, simplet_lithograph_t *litho, cairo_t *ctx);
 
 SIMPLET_HAS_USER_DATA_PROTOS(filter)
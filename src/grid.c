@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <math.h>
+#include "grid.h"
+#include "bounds.h"
+#include "alloc.h"
+
+// Number of cell slots allocated up front, must be a power of two.
+#define SIMPLET_GRID_INITIAL_CELLS 64
+
+// Create and return a new grid with square cells of cell_size pixels,
+// returns NULL on failure.
+simplet_grid_t*
+simplet_grid_new(double cell_size){
+  simplet_grid_t *grid;
+  if(!(grid = simplet_malloc(sizeof(*grid))))
+    return NULL;
+
+  memset(grid, 0, sizeof(*grid));
+
+  if(!(grid->cells = simplet_calloc(SIMPLET_GRID_INITIAL_CELLS, sizeof(*grid->cells)))){
+    simplet_free(grid);
+    return NULL;
+  }
+
+  grid->cells_size = SIMPLET_GRID_INITIAL_CELLS;
+  grid->cell_size  = cell_size > 0 ? cell_size : SIMPLET_GRID_CELL_SIZE;
+
+  return grid;
+}
+
+// Free a grid and its cells.
+void
+simplet_grid_free(simplet_grid_t *grid){
+  for(unsigned int i = 0; i < grid->cells_size; i++)
+    simplet_free(grid->cells[i].boxes);
+  simplet_free(grid->cells);
+  simplet_free(grid->boxes);
+  simplet_free(grid);
+}
+
+// Hash a cell coordinate into a slot.
+static unsigned int
+hash(long x, long y, unsigned int size){
+  unsigned long h = (unsigned long) x * 73856093UL ^ (unsigned long) y * 19349663UL;
+  return (unsigned int) (h ^ (h >> 16)) & (size - 1);
+}
+
+// Find the slot for the cell at x, y. Returns either the cell itself or the
+// empty slot it would be stored in.
+static simplet_grid_cell_t*
+find_cell(simplet_grid_cell_t *cells, unsigned int size, long x, long y){
+  unsigned int slot = hash(x, y, size);
+  while(cells[slot].size && (cells[slot].x != x || cells[slot].y != y))
+    slot = (slot + 1) & (size - 1);
+  return &cells[slot];
+}
+
+// Double the number of cell slots, keeping the table at most half full.
+static simplet_status_t
+grow_cells(simplet_grid_t *grid){
+  unsigned int size = grid->cells_size * 2;
+  simplet_grid_cell_t *cells;
+  if(!(cells = simplet_calloc(size, sizeof(*cells))))
+    return SIMPLET_OOM;
+
+  for(unsigned int i = 0; i < grid->cells_size; i++)
+    if(grid->cells[i].size)
+      *find_cell(cells, size, grid->cells[i].x, grid->cells[i].y) = grid->cells[i];
+
+  simplet_free(grid->cells);
+  grid->cells = cells;
+  grid->cells_size = size;
+  return SIMPLET_OK;
+}
+
+// Append a box index to the cell at x, y creating the cell if need be.
+static simplet_status_t
+add_to_cell(simplet_grid_t *grid, long x, long y, unsigned int box){
+  if((grid->cells_length + 1) * 2 > grid->cells_size && grow_cells(grid) != SIMPLET_OK)
+    return SIMPLET_OOM;
+
+  simplet_grid_cell_t *cell = find_cell(grid->cells, grid->cells_size, x, y);
+  if(!cell->size){
+    if(!(cell->boxes = simplet_malloc(4 * sizeof(*cell->boxes))))
+      return SIMPLET_OOM;
+    cell->x = x;
+    cell->y = y;
+    cell->size = 4;
+    grid->cells_length++;
+  } else if(cell->length == cell->size){
+    unsigned int *boxes;
+    if(!(boxes = simplet_realloc(cell->boxes, cell->size * 2 * sizeof(*boxes))))
+      return SIMPLET_OOM;
+    cell->boxes = boxes;
+    cell->size *= 2;
+  }
+
+  cell->boxes[cell->length++] = box;
+  return SIMPLET_OK;
+}
+
+// Test if bounds overlaps any box previously inserted into the grid. Only
+// the boxes in the cells bounds touches are checked.
+int
+simplet_grid_intersects(simplet_grid_t *grid, simplet_bounds_t *bounds){
+  long minx = floor(bounds->nw.x / grid->cell_size), maxx = floor(bounds->se.x / grid->cell_size);
+  long miny = floor(bounds->se.y / grid->cell_size), maxy = floor(bounds->nw.y / grid->cell_size);
+
+  for(long x = minx; x <= maxx; x++)
+    for(long y = miny; y <= maxy; y++){
+      simplet_grid_cell_t *cell = find_cell(grid->cells, grid->cells_size, x, y);
+      for(unsigned int i = 0; i < cell->length; i++)
+        if(simplet_bounds_intersects(&grid->boxes[cell->boxes[i]], bounds))
+          return 1;
+    }
+
+  return 0;
+}
+
+// Store a copy of bounds in the grid.
+simplet_status_t
+simplet_grid_insert(simplet_grid_t *grid, simplet_bounds_t *bounds){
+  if(grid->boxes_length == grid->boxes_size){
+    unsigned int size = grid->boxes_size ? grid->boxes_size * 2 : 16;
+    simplet_bounds_t *boxes;
+    if(!(boxes = simplet_realloc(grid->boxes, size * sizeof(*boxes))))
+      return SIMPLET_OOM;
+    grid->boxes = boxes;
+    grid->boxes_size = size;
+  }
+
+  unsigned int box = grid->boxes_length++;
+  grid->boxes[box] = *bounds;
+
+  long minx = floor(bounds->nw.x / grid->cell_size), maxx = floor(bounds->se.x / grid->cell_size);
+  long miny = floor(bounds->se.y / grid->cell_size), maxy = floor(bounds->nw.y / grid->cell_size);
+
+  for(long x = minx; x <= maxx; x++)
+    for(long y = miny; y <= maxy; y++)
+      if(add_to_cell(grid, x, y, box) != SIMPLET_OK)
+        return SIMPLET_OOM;
+
+  return SIMPLET_OK;
+}
+
+// Call cb with the index of every box that overlaps bounds, boxes are
+// numbered in the order they were inserted. A box that spans several cells
+// is only reported from the first cell it shares with bounds, so each box is
+// reported once without having to track which boxes have been seen.
+void
+simplet_grid_query(simplet_grid_t *grid, simplet_bounds_t *bounds,
+  void (*cb)(unsigned int box, void *data), void *data){
+  long minx = floor(bounds->nw.x / grid->cell_size), maxx = floor(bounds->se.x / grid->cell_size);
+  long miny = floor(bounds->se.y / grid->cell_size), maxy = floor(bounds->nw.y / grid->cell_size);
+
+  for(long x = minx; x <= maxx; x++)
+    for(long y = miny; y <= maxy; y++){
+      simplet_grid_cell_t *cell = find_cell(grid->cells, grid->cells_size, x, y);
+      for(unsigned int i = 0; i < cell->length; i++){
+        simplet_bounds_t *box = &grid->boxes[cell->boxes[i]];
+        if(!simplet_bounds_intersects(box, bounds)) continue;
+
+        long firstx = floor(box->nw.x / grid->cell_size), firsty = floor(box->se.y / grid->cell_size);
+        if(x == (firstx > minx ? firstx : minx) && y == (firsty > miny ? firsty : miny))
+          cb(cell->boxes[i], data);
+      }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef _SIMPLE_TILES_GRID_H
+#define _SIMPLE_TILES_GRID_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Default width and height of a grid cell in pixels, roughly the size of
+// a short label.
+#define SIMPLET_GRID_CELL_SIZE 64
+
+// A cell in the grid, holding the indexes of the boxes that touch it.
+typedef struct {
+  long x;
+  long y;
+  unsigned int *boxes;
+  unsigned int length;
+  unsigned int size;
+} simplet_grid_cell_t;
+
+// A uniform grid over pixel space used to find overlapping boxes. Cells
+// are stored in a hash table keyed on their coordinates, so only cells
+// that have boxes in them take up memory, and the grid isn't limited to
+// the extent of a single tile.
+typedef struct {
+  double cell_size;
+  simplet_bounds_t    *boxes;
+  unsigned int        boxes_length;
+  unsigned int        boxes_size;
+  simplet_grid_cell_t *cells;
+  unsigned int        cells_length;
+  unsigned int        cells_size;
+} simplet_grid_t;
+
+simplet_grid_t*
+simplet_grid_new(double cell_size);
+
+void
+simplet_grid_free(simplet_grid_t *grid);
+
+int
+simplet_grid_intersects(simplet_grid_t *grid, simplet_bounds_t *bounds);
+
+simplet_status_t
+simplet_grid_insert(simplet_grid_t *grid, simplet_bounds_t *bounds);
+
+void
+simplet_grid_query(simplet_grid_t *grid, simplet_bounds_t *bounds,
+  void (*cb)(unsigned int box, void *data), void *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,8 +1,10 @@
 #include "error.h"
+#include "shape.h"
+#include "anchor.h"
 #include <pthread.h>
 #include <assert.h>
 
-static int initialized = 0;
+static pthread_once_t initialized = PTHREAD_ONCE_INIT;
 
 // The atexit handler used to close all connections to open data stores
 static void
@@ -12,15 +14,22 @@ cleanup(){
       OGRReleaseDataSource(OGRGetOpenDS(i));
   assert(!OGRGetOpenDSCount());
   OGRCleanupAll();
+  simplet_shape_cache_clear();
+  simplet_anchor_cache_clear();
 }
 
 
 // Initialize libraries, register the atexit handler and set up error reporting.
-void
-simplet_init(){
-  if(initialized) return;
+static void
+init(){
   simplet_error_init();
   OGRRegisterAll();
   atexit(cleanup);
-  initialized = 1;
+}
+
+// Run the library initialization exactly once, even if maps are created
+// from several threads at the same time.
+void
+simplet_init(){
+  pthread_once(&initialized, init);
 };
@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <math.h>
+#include <cpl_error.h>
+#include "labels.h"
+#include "error.h"
+#include "map.h"
+#include "layer.h"
+#include "filter.h"
+#include "style.h"
+#include "shape.h"
+#include "anchor.h"
+#include "list.h"
+#include "bounds.h"
+#include "alloc.h"
+
+// Add error reporting to simplet_labels_t.
+SIMPLET_ERROR_FUNC(labels_t)
+
+// Pixels per mercator meter at zoom.
+static double
+world_scale(unsigned int zoom){
+  return SIMPLET_SLIPPY_SIZE * pow(2.0, zoom) / SIMPLET_MERC_LENGTH;
+}
+
+// Label every feature of a filter, using the same lithograph rules a tile
+// render does but with proj_ctx mapping the map's projection to world pixels.
+static simplet_status_t
+place_filter(simplet_labels_t *labels, simplet_map_t *map, simplet_filter_t *filter,
+  OGRDataSourceH source, simplet_lithograph_t *litho, cairo_t *proj_ctx){
+  simplet_compiled_styles_t styles;
+  simplet_compile_styles(filter->styles, &styles);
+  if(!(styles.set & SIMPLET_STYLE_TEXT_FIELD)) {
+    simplet_release_compiled_styles(&styles);
+    return SIMPLET_OK;
+  }
+
+  OGRLayerH olayer;
+  if(!(olayer = OGR_DS_ExecuteSQL(source, filter->ogrsql, NULL, NULL))){
+    simplet_release_compiled_styles(&styles);
+    if(!CPLGetLastErrorNo())
+      return SIMPLET_OK;
+    return set_error(labels, SIMPLET_OGR_ERR, CPLGetLastErrorMsg());
+  }
+
+  OGRSpatialReferenceH srs;
+  OGRCoordinateTransformationH transform = NULL;
+  if(!(srs = OGR_L_GetSpatialRef(olayer)) || !(transform = OCTNewCoordinateTransformation(srs, map->proj))){
+    OGR_DS_ReleaseResultSet(source, olayer);
+    simplet_release_compiled_styles(&styles);
+    return set_error(labels, SIMPLET_OGR_ERR, "could not transform labels to the map's projection");
+  }
+
+  // A label budget is per tile and doesn't apply to the whole world, but
+  // priorities still decide which labels win.
+  styles.set &= ~SIMPLET_STYLE_TEXT_LIMIT;
+
+  unsigned int anchors = simplet_anchor_namespace(OGR_DS_GetName(source), filter->ogrsql);
+  OGRFeatureH feature;
+  while((feature = OGR_L_GetNextFeature(olayer))){
+    double x, y;
+    if(simplet_anchor_find(anchors, feature, transform, &x, &y))
+      simplet_lithograph_add_placement(litho, feature, &styles, proj_ctx, x, y);
+    OGR_F_Destroy(feature);
+  }
+  simplet_lithograph_flush(litho, &styles);
+
+  OCTDestroyCoordinateTransformation(transform);
+  OGR_DS_ReleaseResultSet(source, olayer);
+  simplet_release_compiled_styles(&styles);
+
+  if(litho->error.status != SIMPLET_OK)
+    return set_error(labels, litho->error.status, litho->error.msg);
+  return SIMPLET_OK;
+}
+
+// Label every visible filter of a layer.
+static simplet_status_t
+place_layer(simplet_labels_t *labels, simplet_map_t *map, simplet_layer_t *layer,
+  simplet_lithograph_t *litho, cairo_t *proj_ctx){
+  if(!simplet_layer_is_visible(layer, labels->zoom))
+    return SIMPLET_OK;
+
+  OGRDataSourceH source;
+  if(!(source = OGROpenShared(layer->source, 0, NULL)))
+    return set_error(labels, SIMPLET_OGR_ERR, "error opening layer source");
+
+  simplet_listiter_t iter;
+  simplet_list_iter_init(layer->filters, &iter);
+
+  simplet_filter_t *filter;
+  while((filter = simplet_list_next(&iter))){
+    if(!simplet_filter_is_visible(filter, labels->zoom)) continue;
+
+    simplet_labels_range_t *ranges;
+    if(!(ranges = simplet_realloc(labels->ranges, (labels->ranges_length + 1) * sizeof(*ranges)))){
+      OGRReleaseDataSource(source);
+      return set_error(labels, SIMPLET_OOM, "out of memory adding label range");
+    }
+    labels->ranges = ranges;
+
+    simplet_labels_range_t *range = &labels->ranges[labels->ranges_length++];
+    range->filter = filter;
+    range->start  = simplet_list_get_length(litho->placements);
+
+    if(place_filter(labels, map, filter, source, litho, proj_ctx) != SIMPLET_OK){
+      OGRReleaseDataSource(source);
+      return labels->error.status;
+    }
+
+    range->end = simplet_list_get_length(litho->placements);
+  }
+
+  OGRReleaseDataSource(source);
+  return SIMPLET_OK;
+}
+
+// Run label placement for every layer of the map over the whole world.
+static simplet_status_t
+place_all(simplet_labels_t *labels, simplet_map_t *map){
+  // A lithograph only needs a surface for its Pango context, nothing is drawn.
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+  if(cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surface);
+    return set_error(labels, SIMPLET_CAIRO_ERR, "could not create label surface");
+  }
+
+  cairo_t *litho_ctx = cairo_create(surface);
+  cairo_t *proj_ctx  = cairo_create(surface);
+  simplet_lithograph_t *litho = simplet_lithograph_new(litho_ctx);
+  cairo_destroy(litho_ctx);
+  if(!litho) {
+    cairo_destroy(proj_ctx);
+    cairo_surface_destroy(surface);
+    return set_error(labels, SIMPLET_OOM, "out of memory creating lithograph");
+  }
+
+  // Map mercator meters to world pixels, with y growing down.
+  double scale = world_scale(labels->zoom), origin = SIMPLET_MERC_LENGTH / 2;
+  cairo_matrix_t mat;
+  cairo_matrix_init(&mat, scale, 0, 0, -scale, origin * scale, origin * scale);
+  cairo_set_matrix(proj_ctx, &mat);
+
+  simplet_listiter_t iter;
+  simplet_list_iter_init(map->layers, &iter);
+  simplet_layer_t *layer;
+  while((layer = simplet_list_next(&iter)))
+    if(place_layer(labels, map, layer, litho, proj_ctx) != SIMPLET_OK)
+      break;
+
+  // Keep the placements and let the lithograph go.
+  labels->placement_list = litho->placements;
+  litho->placements = NULL;
+  simplet_lithograph_free(litho);
+  cairo_destroy(proj_ctx);
+  cairo_surface_destroy(surface);
+  return labels->error.status;
+}
+
+// Build the index used to find the labels on a tile.
+static simplet_status_t
+build_index(simplet_labels_t *labels){
+  unsigned int length = simplet_list_get_length(labels->placement_list);
+  if(!(labels->index = simplet_grid_new(SIMPLET_GRID_CELL_SIZE)))
+    return set_error(labels, SIMPLET_OOM, "out of memory creating label index");
+  if(length && !(labels->placements = simplet_malloc(length * sizeof(*labels->placements))))
+    return set_error(labels, SIMPLET_OOM, "out of memory indexing labels");
+
+  simplet_listiter_t iter;
+  simplet_list_iter_init(labels->placement_list, &iter);
+  simplet_placement_t *placement;
+  while((placement = simplet_list_next(&iter))){
+    labels->placements[labels->placements_length++] = placement;
+    if(simplet_grid_insert(labels->index, placement->bounds) != SIMPLET_OK)
+      return set_error(labels, SIMPLET_OOM, "out of memory indexing labels");
+  }
+
+  return SIMPLET_OK;
+}
+
+// Place the labels of every layer in map across the whole world at zoom,
+// using the same collision rules as a tile render. The map must be in
+// SIMPLET_MERCATOR. Check the result for errors with its error status,
+// returns NULL when out of memory.
+simplet_labels_t*
+simplet_labels_new(simplet_map_t *map, unsigned int zoom){
+  simplet_labels_t *labels;
+  if(!(labels = simplet_malloc(sizeof(*labels))))
+    return NULL;
+
+  memset(labels, 0, sizeof(*labels));
+  labels->error.status = SIMPLET_OK;
+  labels->zoom = zoom;
+
+  if(!map->proj) {
+    set_error(labels, SIMPLET_ERR, "labels need a map projection");
+    return labels;
+  }
+
+  if(place_all(labels, map) == SIMPLET_OK)
+    build_index(labels);
+
+  return labels;
+}
+
+// Free labels and their placements.
+void
+simplet_labels_free(simplet_labels_t *labels){
+  if(labels->placement_list) {
+    simplet_list_set_item_free(labels->placement_list, simplet_placement_vfree);
+    simplet_list_free(labels->placement_list);
+  }
+  if(labels->index)
+    simplet_grid_free(labels->index);
+  simplet_free(labels->placements);
+  simplet_free(labels->ranges);
+  simplet_free(labels);
+}
+
+// Free labels stored in a list.
+void
+simplet_labels_vfree(void *labels){
+  simplet_labels_free(labels);
+}
+
+// Find the labels in list placed at the zoom and scale of render, returns
+// NULL if there aren't any.
+simplet_labels_t*
+simplet_labels_find(simplet_list_t *list, simplet_render_t *render){
+  if(!list || render->zoom < 0 || !(render->bounds.width > 0))
+    return NULL;
+
+  simplet_listiter_t iter;
+  simplet_list_iter_init(list, &iter);
+  simplet_labels_t *labels, *found = NULL;
+  while((labels = simplet_list_next(&iter))){
+    if(labels->zoom != (unsigned int) render->zoom || labels->error.status != SIMPLET_OK)
+      continue;
+
+    double scale = world_scale(labels->zoom);
+    if(fabs(render->width / render->bounds.width - scale) <= scale * 1e-9)
+      found = labels;
+  }
+
+  return found;
+}
+
+// The state needed to draw placements found in the index.
+typedef struct {
+  simplet_labels_t *labels;
+  simplet_labels_range_t *range;
+  cairo_t *ctx;
+  double x;
+  double y;
+  int show;
+} draw_t;
+
+// Add a placement to the path if it belongs to the filter being drawn.
+static void
+draw_placement(unsigned int idx, void *data){
+  draw_t *draw = data;
+  if(idx < draw->range->start || idx >= draw->range->end) return;
+
+  simplet_placement_t *placement = draw->labels->placements[idx];
+  double x = placement->bounds->nw.x - draw->x, y = placement->bounds->se.y - draw->y;
+  if(draw->show)
+    simplet_shape_show(placement->shape, draw->ctx, x, y);
+  else
+    simplet_shape_path(placement->shape, draw->ctx, x, y);
+}
+
+// Draw the labels filter placed that fall on the render's tile to ctx.
+void
+simplet_labels_apply(simplet_labels_t *labels, simplet_filter_t *filter,
+  simplet_render_t *render, cairo_t *ctx, simplet_compiled_styles_t *styles){
+  draw_t draw = { labels, NULL, ctx, 0, 0, 0 };
+  for(unsigned int i = 0; i < labels->ranges_length; i++)
+    if(labels->ranges[i].filter == filter)
+      draw.range = &labels->ranges[i];
+  if(!draw.range || draw.range->start == draw.range->end) return;
+
+  // Find the top left corner of the tile in world pixels.
+  double scale = world_scale(labels->zoom), origin = SIMPLET_MERC_LENGTH / 2;
+  draw.x = (render->bounds.nw.x + origin) * scale;
+  draw.y = (origin - render->bounds.nw.y) * scale;
+
+  simplet_bounds_t tile;
+  simplet_bounds_init(&tile);
+  simplet_bounds_extend(&tile, draw.x, draw.y);
+  simplet_bounds_extend(&tile, draw.x + render->width, draw.y + render->height);
+
+  // As with simplet_lithograph_apply, labels without a halo are drawn from
+  // cairo's glyph cache.
+  cairo_save(ctx);
+  if((draw.show = simplet_compiled_styles_fill_only(styles)))
+    simplet_set_compiled_color(ctx, &styles->color);
+  simplet_grid_query(labels->index, &tile, draw_placement, &draw);
+  if(!draw.show) {
+    simplet_apply_compiled_styles(ctx, styles, SIMPLET_STYLE_TEXT);
+    cairo_new_path(ctx);
+  }
+  cairo_restore(ctx);
+}
@@ -0,0 +1,54 @@
+#ifndef _SIMPLE_TILES_LABELS_H
+#define _SIMPLE_TILES_LABELS_H
+
+#include "types.h"
+#include "text.h"
+#include "grid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The placements a single filter made, as a range of indexes into the
+// placements array.
+typedef struct {
+  simplet_filter_t *filter;
+  unsigned int start;
+  unsigned int end;
+} simplet_labels_range_t;
+
+// Labels placed over the whole world for one zoom level ahead of time.
+// Placement bounds are in world pixels, where the top left corner of the
+// world is 0, 0 and the world is 256 * 2^zoom pixels across.
+typedef struct simplet_labels_t {
+  SIMPLET_ERROR_FIELDS
+  unsigned int zoom;
+  simplet_placement_t    **placements;
+  unsigned int           placements_length;
+  simplet_list_t         *placement_list;
+  simplet_labels_range_t *ranges;
+  unsigned int           ranges_length;
+  simplet_grid_t         *index;
+} simplet_labels_t;
+
+simplet_labels_t*
+simplet_labels_new(simplet_map_t *map, unsigned int zoom);
+
+void
+simplet_labels_free(simplet_labels_t *labels);
+
+void
+simplet_labels_vfree(void *labels);
+
+simplet_labels_t*
+simplet_labels_find(simplet_list_t *list, simplet_render_t *render);
+
+void
+simplet_labels_apply(simplet_labels_t *labels, simplet_filter_t *filter,
+  simplet_render_t *render, cairo_t *ctx, simplet_compiled_styles_t *styles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,7 +26,7 @@ simplet_filter_t*
 simplet_layer_add_filter_directly(simplet_layer_t *layer, simplet_filter_t *filter);
 
 simplet_status_t
-simplet_layer_process(simplet_layer_t *layer, simplet_map_t *map, simplet_lithograph_t *litho, cairo_t *ctx);
+simplet_layer_process(simplet_layer_t *layer, simplet_render_t *render, simplet_lithograph_t *litho, cairo_t *ctx);
 
 void
 simplet_layer_get_source(simplet_layer_t *layer, char **source);
@@ -34,6 +34,18 @@ simplet_layer_get_source(simplet_layer_t *layer, char **source);
 void
 simplet_layer_set_source(simplet_layer_t *layer, char *source);
 
+void
+simplet_layer_get_name(simplet_layer_t *layer, char **name);
+
+void
+simplet_layer_set_name(simplet_layer_t *layer, const char *name);
+
+void
+simplet_layer_set_zoom_range(simplet_layer_t *layer, unsigned int min, unsigned int max);
+
+int
+simplet_layer_is_visible(simplet_layer_t *layer, int zoom);
+
 SIMPLET_HAS_USER_DATA_PROTOS(layer)
 
 
@@ -1,11 +1,15 @@
 #include "list.h"
+#include "alloc.h"
 #include <stdlib.h>
 
+// Number of items a list has room for after its first push.
+#define SIMPLET_LIST_MIN_SIZE 8
+
 // Create a new list, returns NULL on failure.
 simplet_list_t*
 simplet_list_new(){
   simplet_list_t* list;
-  if(!(list = malloc(sizeof(*list))))
+  if(!(list = simplet_malloc(sizeof(*list))))
     return NULL;
 
   memset(list, 0, sizeof(*list));
@@ -13,26 +17,20 @@ simplet_list_new(){
   return list;
 }
 
-// Push a void pointer on the the end of the list.
+// Push a void pointer on the the end of the list. Items are kept in a single
+// array that doubles in size when full. Returns NULL on failure.
 void*
 simplet_list_push(simplet_list_t *list, void* val){
-  simplet_node_t *node;
-  if(!(node = malloc(sizeof(*node))))
-    return NULL;
-
-  node->user_data = val;
-
-  if(!(list->head || list->tail)) {
-    list->head = list->tail = node;
-    node->next = node->prev = NULL;
-  } else {
-    node->next = NULL;
-    node->prev = list->tail;
-    list->tail->next = node;
-    list->tail = node;
+  if(list->length == list->size) {
+    unsigned int size = list->size ? list->size * 2 : SIMPLET_LIST_MIN_SIZE;
+    void **items;
+    if(!(items = simplet_realloc(list->items, size * sizeof(*items))))
+      return NULL;
+    list->items = items;
+    list->size  = size;
   }
 
-  list->length++;
+  list->items[list->length++] = val;
   return val;
 }
 
@@ -45,45 +43,29 @@ simplet_list_get_length(simplet_list_t *list){
 // Get the last element on the list.
 void*
 simplet_list_tail(simplet_list_t *list){
-  return list->tail->user_data;
+  return list->length ? list->items[list->length - 1] : NULL;
 }
 
 // Get the first element of the list.
 void*
 simplet_list_head(simplet_list_t *list){
-  return list->head->user_data;
+  return list->length ? list->items[0] : NULL;
 }
 
 // Remove and return the last element of the list.
 void*
 simplet_list_pop(simplet_list_t *list){
-  if(!list->tail)
+  if(!list->length)
     return NULL;
 
-  simplet_node_t *node = list->tail;
-  void *val = node->user_data;
-
-  if (node->prev)
-    node->prev->next = NULL;
-  else
-    list->head = NULL;
-
-  list->tail = node->prev;
-
-  free(node);
-  list->length--;
-  return val;
+  return list->items[--list->length];
 }
 
 // Get an element at idx.
 void*
 simplet_list_get(simplet_list_t* list, unsigned int idx){
-  if(idx > list->length) return NULL;
-  simplet_node_t *n = list->head;
-  if(idx <= 0) return n->user_data;
-  while(idx-- && n) n = n->next;
-  if(n) return n->user_data;
-  return NULL;
+  if(idx >= list->length) return NULL;
+  return list->items[idx];
 }
 
 // Free a list and call the previously set free function for eaxh element in the
@@ -93,7 +75,8 @@ simplet_list_free(simplet_list_t *list){
   void* val;
   while((val = simplet_list_pop(list)) != NULL)
     if(list->free) list->free(val);
-  free(list);
+  simplet_free(list->items);
+  simplet_free(list);
 }
 
 // Set the free function for a list.
@@ -102,20 +85,32 @@ simplet_list_set_item_free(simplet_list_t *list, simplet_user_data_free destroy)
   list->free = destroy;
 }
 
-// Free a list iterator.
+// Free a list iterator, iterators set up with simplet_list_iter_init are
+// left alone.
 void
 simplet_list_iter_free(simplet_listiter_t* iter){
-  free(iter);
+  if(iter->heap) simplet_free(iter);
 }
 
-// Return a list iterator. TODO: this doesn't really need to be on the heap,
-// we should switch to stack allocation perhaps?
+// Set up an iterator over list, usually on the stack, so looping over a list
+// doesn't allocate. Returns iter.
+simplet_listiter_t*
+simplet_list_iter_init(simplet_list_t *list, simplet_listiter_t *iter){
+  iter->list = list;
+  iter->next = 0;
+  iter->heap = 0;
+  return iter;
+}
+
+// Return a list iterator allocated on the heap, it is freed once the last
+// element has been returned. Prefer simplet_list_iter_init.
 simplet_listiter_t*
 simplet_get_list_iter(simplet_list_t *list){
   simplet_listiter_t* iter;
-  if(!(iter = malloc(sizeof(*iter))))
+  if(!(iter = simplet_malloc(sizeof(*iter))))
     return NULL;
-  iter->next = list->head;
+  simplet_list_iter_init(list, iter);
+  iter->heap = 1;
   return iter;
 }
 
@@ -123,13 +118,8 @@ simplet_get_list_iter(simplet_list_t *list){
 void*
 simplet_list_next(simplet_listiter_t* iter){
   if(!iter) return NULL;
-  simplet_node_t *current = iter->next;
-  if(current != NULL) {
-    iter->next = current->next;
-    return current->user_data;
-  } else {
-    simplet_list_iter_free(iter);
-  }
+  if(iter->next < iter->list->length)
+    return iter->list->items[iter->next++];
+  simplet_list_iter_free(iter);
   return NULL;
 }
-
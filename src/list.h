@@ -22,6 +22,9 @@ simplet_list_free(simplet_list_t* list);
 void*
 simplet_list_get(simplet_list_t* list, unsigned int idx);
 
+simplet_listiter_t*
+simplet_list_iter_init(simplet_list_t *list, simplet_listiter_t *iter);
+
 simplet_listiter_t*
 simplet_get_list_iter(simplet_list_t* list);
 
@@ -10,12 +10,10 @@
 #include "util.h"
 #include "bounds.h"
 #include "text.h"
-
-// Output size of a slippy tile.
-#define SIMPLET_SLIPPY_SIZE 256
-
-// Size of the earth in mercator meters.
-#define SIMPLET_MERC_LENGTH 40075016.68
+#include "render.h"
+#include "labels.h"
+#include "arena.h"
+#include "alloc.h"
 
 // Add user_data methods to simplet_map_t.
 SIMPLET_HAS_USER_DATA(map)
@@ -25,23 +23,24 @@ simplet_map_t*
 simplet_map_new(){
   simplet_init();
   simplet_map_t *map;
-  if(!(map = malloc(sizeof(*map))))
+  if(!(map = simplet_malloc(sizeof(*map))))
     return NULL;
 
   memset(map, 0, sizeof(*map));
 
   if(!(map->layers = simplet_list_new())){
-    free(map);
+    simplet_free(map);
     return NULL;
   }
 
   if(!(map->bounds = simplet_bounds_new())){
     simplet_list_free(map->layers);
-    free(map);
+    simplet_free(map);
     return NULL;
   }
 
   map->error.status = SIMPLET_OK;
+  map->zoom = -1;
 
   return map;
 }
@@ -61,17 +60,40 @@ simplet_map_free(simplet_map_t *map){
     OSRRelease(map->proj);
 
   if(map->bgcolor)
-    free(map->bgcolor);
+    simplet_free(map->bgcolor);
+
+  if(map->labels) {
+    simplet_list_set_item_free(map->labels, simplet_labels_vfree);
+    simplet_list_free(map->labels);
+  }
+
+  if(map->arena)
+    simplet_arena_free(map->arena);
 
-  free(map);
+  simplet_free(map);
 }
 
 // Add error reporting to simplet_map_t. Macro defined in <b>error.h</b>
 SIMPLET_ERROR_FUNC(map_t)
 
+// Check if proj is SIMPLET_MERCATOR.
+static int
+is_mercator(OGRSpatialReferenceH proj){
+  OGRSpatialReferenceH mercator;
+  if(!(mercator = OSRNewSpatialReference(NULL)))
+    return 0;
+
+  int same = OSRSetFromUserInput(mercator, SIMPLET_MERCATOR) == OGRERR_NONE
+          && OSRIsSame(proj, mercator);
+  OSRRelease(mercator);
+  return same;
+}
+
 // Set the projection on the map.
 simplet_status_t
 simplet_map_set_srs(simplet_map_t *map, const char *proj){
+  map->mercator = 0;
+
   // If this map has a projection and bounds already,
   // it needs to reproject the bounds to the new srs.
   if(map->proj) {
@@ -80,6 +102,7 @@ simplet_map_set_srs(simplet_map_t *map, const char *proj){
       char *s;
       simplet_map_get_srs(map, &s);
       map->bounds = simplet_bounds_reproject(map->bounds, (const char *) s, (const char *) proj);
+      // The string comes from OGR, not simplet_malloc.
       free(s);
       simplet_bounds_free(tmp);
     }
@@ -92,6 +115,7 @@ simplet_map_set_srs(simplet_map_t *map, const char *proj){
   if(OSRSetFromUserInput(map->proj, proj) != OGRERR_NONE)
     return set_error(map, SIMPLET_OGR_ERR, "bad projection string");
 
+  map->mercator = is_mercator(map->proj);
   return SIMPLET_OK;
 }
 
@@ -107,6 +131,12 @@ simplet_map_get_buffer(simplet_map_t *map){
   return map->buffer;
 }
 
+// Copy the stage timings and counters of the map's last render into stats.
+void
+simplet_map_get_stats(simplet_map_t *map, simplet_stats_t *stats){
+  *stats = map->stats;
+}
+
 // Store the proj4 string representation of the map in srs
 void
 simplet_map_get_srs(simplet_map_t *map, char **srs){
@@ -135,7 +165,7 @@ simplet_map_set_size(simplet_map_t *map, int width, int height){
 // Set the background color of the map to a copy of str.
 simplet_status_t
 simplet_map_set_bgcolor(simplet_map_t *map, const char *str){
-  free(map->bgcolor);
+  simplet_free(map->bgcolor);
   if((map->bgcolor = simplet_copy_string(str)))
     return SIMPLET_OK;
   return set_error(map, SIMPLET_OOM, "couldn't copy bgcolor");
@@ -158,9 +188,26 @@ simplet_map_set_bounds(simplet_map_t *map, double maxx, double maxy, double minx
 
   simplet_bounds_extend(map->bounds, maxx, maxy);
   simplet_bounds_extend(map->bounds, minx, miny);
+
+  // Arbitrary bounds aren't at a known zoom level.
+  map->zoom = -1;
   return SIMPLET_OK;
 }
 
+// Set the zoom level used to decide which layers and filters are visible,
+// -1 means every layer and filter is drawn. This is set by
+// simplet_map_set_slippy and reset by simplet_map_set_bounds.
+void
+simplet_map_set_zoom(simplet_map_t *map, int zoom){
+  map->zoom = zoom;
+}
+
+// Return the map's zoom level or -1 if it isn't known.
+int
+simplet_map_get_zoom(simplet_map_t *map){
+  return map->zoom;
+}
+
 // Sets the bounds and correct size for a map tile, uses
 // [tile coordinates](http://code.google.com/apis/maps/documentation/javascript/maptypes.html#CustomMapTypes)
 simplet_status_t
@@ -181,6 +228,7 @@ simplet_map_set_slippy(simplet_map_t *map, unsigned int x, unsigned int y, unsig
                                   origin - y * length))
     return simplet_error((simplet_errorable_t *) map, SIMPLET_OOM, "out of memory setting bounds");
 
+  simplet_map_set_zoom(map, z);
   return SIMPLET_OK;
 }
 
@@ -252,81 +300,86 @@ simplet_map_is_valid(simplet_map_t *map){
   return SIMPLET_OK;
 }
 
-// Build a rendering context to draw the map on.
-static cairo_surface_t *
-build_surface(simplet_map_t *map){
-  // Check if the map is valid.
-  if(simplet_map_is_valid(map) == SIMPLET_ERR)
-    return NULL;
-
-  // Create a cairo surface to draw on.
-  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
-      map->width, map->height);
-
-  if(cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
-    return NULL;
-
-  cairo_t *ctx = cairo_create(surface);
-
-  // Paint the background color.
-  if(map->bgcolor) simplet_style_paint(ctx, map->bgcolor);
-
-  simplet_listiter_t *iter = simplet_get_list_iter(map->layers);
-  simplet_layer_t *layer;
-  simplet_status_t err;
-
-  cairo_t *litho_ctx = cairo_create(surface);
-
-  // Set up a map-wide text structure.
-  simplet_lithograph_t *litho = simplet_lithograph_new(litho_ctx);
-
-  // Set a sensible default.
-  simplet_style_line_join(litho_ctx, "round");
+// Place the labels of every layer across the whole world at zoom ahead of
+// time. Renders at that zoom then draw the labels that fall on their tile
+// instead of placing labels themselves, so labels match across tile edges.
+// The map must be in SIMPLET_MERCATOR, and labels need to be placed again
+// after the map's layers or styles change, which replaces those placed at
+// the zoom before.
+simplet_status_t
+simplet_map_place_labels(simplet_map_t *map, unsigned int zoom){
+  if(!map->labels && !(map->labels = simplet_list_new()))
+    return set_error(map, SIMPLET_OOM, "out of memory creating label list");
+
+  simplet_labels_t *labels;
+  if(!(labels = simplet_labels_new(map, zoom)))
+    return set_error(map, SIMPLET_OOM, "out of memory placing labels");
+
+  if(labels->error.status != SIMPLET_OK) {
+    map->error = labels->error;
+    simplet_labels_free(labels);
+    return map->error.status;
+  }
 
-  // Iterate through and draw all the layers on the cairo context.
-  while((layer = simplet_list_next(iter))){
-    err = simplet_layer_process(layer, map, litho, ctx);
-    if(err != SIMPLET_OK) {
-      simplet_list_iter_free(iter);
-      set_error(map, err, "error in rendering");
-      break;
+  // Replace the labels already placed at this zoom.
+  for(unsigned int i = 0; i < map->labels->length; i++){
+    simplet_labels_t *placed = map->labels->items[i];
+    if(placed->zoom == zoom) {
+      simplet_labels_free(placed);
+      map->labels->items[i] = labels;
+      return SIMPLET_OK;
     }
   }
 
-  simplet_lithograph_free(litho);
-  cairo_destroy(ctx);
-  cairo_destroy(litho_ctx);
-  return surface;
+  if(!simplet_list_push(map->labels, labels)) {
+    simplet_labels_free(labels);
+    return set_error(map, SIMPLET_OOM, "out of memory storing labels");
+  }
+
+  return SIMPLET_OK;
 }
 
-// Free the surface we've created.
+// Render the map with its own bounds and size, errors from the render are
+// stored on the map. The render borrows the map's arena, so its blocks are
+// reused by every render of the map rather than allocated for each one.
+// Since this writes the map's error, stats and arena, a map must not be
+// rendered this way from two threads at once, threads should each render
+// it with their own simplet_render_t instead.
 static void
-close_surface(cairo_surface_t *surface){
-  cairo_surface_destroy(surface);
+render_map(simplet_map_t *map, void *stream, const char *path,
+  cairo_status_t (*cb)(void *closure, const unsigned char *data, unsigned int length)){
+  // Check if the map is valid.
+  if(simplet_map_is_valid(map) == SIMPLET_ERR)
+    return;
+
+  simplet_render_t render;
+  if(simplet_render_init(&render, map) == SIMPLET_OK) {
+    render.arena = map->arena;
+    if(path)
+      simplet_render_to_png(&render, path);
+    else
+      simplet_render_to_stream(&render, stream, cb);
+
+    // Take the arena back, the render creates it the first time.
+    map->arena   = render.arena;
+    render.arena = NULL;
+  }
+
+  if(render.error.status != SIMPLET_OK)
+    map->error = render.error;
+  map->stats = render.stats;
+  simplet_render_release(&render);
 }
 
 // Render the map and emit a stream of chunks to closure
 void
 simplet_map_render_to_stream(simplet_map_t *map, void *stream,
   cairo_status_t (*cb)(void *closure, const unsigned char *data, unsigned int length)){
-  cairo_surface_t *surface;
-  if(!(surface = build_surface(map))) return;
-
-  if(cairo_surface_write_to_png_stream(surface, cb, stream) != CAIRO_STATUS_SUCCESS)
-    set_error(map, SIMPLET_CAIRO_ERR, cairo_status_to_string(cairo_surface_status(surface)));
-
-  close_surface(surface);
+  render_map(map, stream, NULL, cb);
 }
 
 // Render the map to a file on disk.
 void
 simplet_map_render_to_png(simplet_map_t *map, const char *path){
-  cairo_surface_t *surface;
-  if(!(surface = build_surface(map))) return;
-
-  if(cairo_surface_write_to_png(surface, path) != CAIRO_STATUS_SUCCESS)
-    set_error(map, SIMPLET_CAIRO_ERR, cairo_status_to_string(cairo_surface_status(surface)));
-
-  close_surface(surface);
+  render_map(map, NULL, path, NULL);
 }
-
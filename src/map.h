@@ -8,6 +8,12 @@
 extern "C" {
 #endif
 
+// Output size of a slippy tile.
+#define SIMPLET_SLIPPY_SIZE 256
+
+// Size of the earth in mercator meters.
+#define SIMPLET_MERC_LENGTH 40075016.68
+
 simplet_map_t*
 simplet_map_new();
 
@@ -44,6 +50,9 @@ simplet_map_status_to_string(simplet_map_t *map);
 simplet_status_t
 simplet_map_is_valid(simplet_map_t *map);
 
+simplet_status_t
+simplet_map_place_labels(simplet_map_t *map, unsigned int zoom);
+
 void
 simplet_map_render_to_png(simplet_map_t *map, const char *path);
 
@@ -60,9 +69,18 @@ simplet_map_set_slippy(simplet_map_t *map, unsigned int x, unsigned int y, unsig
 void
 simplet_map_init_matrix(simplet_map_t *map, cairo_matrix_t *mat);
 
+void
+simplet_map_set_zoom(simplet_map_t *map, int zoom);
+
+int
+simplet_map_get_zoom(simplet_map_t *map);
+
 double
 simplet_map_get_buffer(simplet_map_t *map);
 
+void
+simplet_map_get_stats(simplet_map_t *map, simplet_stats_t *stats);
+
 void
 simplet_map_set_buffer(simplet_map_t *map, double buffer);
 
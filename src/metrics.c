@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include "metrics.h"
+#include "anchor.h"
+#include "shape.h"
+#include "util.h"
+#include "alloc.h"
+
+// Layers are kept apart up to this many names, any more are counted
+// together so a process opening endless layers doesn't grow without bound.
+#define SIMPLET_METRICS_MAX_LAYERS 256
+
+// Upper bounds of the latency buckets in seconds.
+static const double bounds[SIMPLET_METRICS_BUCKETS] = {
+  0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+
+// Names of each simplet_status_t.
+static const char *statuses[SIMPLET_OK + 1] = { "error", "oom", "cairo", "ogr", "ok" };
+
+typedef struct {
+  unsigned long buckets[SIMPLET_METRICS_BUCKETS]; // not cumulative, +Inf is count
+  unsigned long count;
+  double sum;
+} histogram_t;
+
+typedef struct {
+  char *name; // NULL for the layers past SIMPLET_METRICS_MAX_LAYERS
+  histogram_t latency;
+  unsigned long queries;
+} layer_t;
+
+// Totals across every render in the process.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+  histogram_t zooms[SIMPLET_METRICS_ZOOMS + 1];
+  layer_t *layers;
+  unsigned int layers_length;
+  unsigned long renders[SIMPLET_OK + 1];
+  unsigned long bytes_encoded;
+  unsigned long features_read;
+  unsigned long labels_placed;
+} metrics;
+
+// Add an observation of seconds to a histogram.
+static void
+observe(histogram_t *histogram, double seconds){
+  unsigned int i = 0;
+  while(i < SIMPLET_METRICS_BUCKETS && seconds > bounds[i]) i++;
+  if(i < SIMPLET_METRICS_BUCKETS) histogram->buckets[i]++;
+  histogram->count++;
+  histogram->sum += seconds;
+}
+
+// Find the totals for the layer named name, adding them if this is a new
+// layer. Called with the lock held, returns NULL when out of memory.
+static layer_t *
+find_layer(const char *name){
+  unsigned int i;
+  for(i = 0; i < metrics.layers_length; i++){
+    layer_t *layer = &metrics.layers[i];
+    if(!layer->name || !strcmp(layer->name, name))
+      return layer;
+  }
+
+  layer_t *layers;
+  if(!(layers = simplet_realloc(metrics.layers, (i + 1) * sizeof(*layers))))
+    return NULL;
+  metrics.layers = layers;
+
+  layer_t *layer = &layers[i];
+  memset(layer, 0, sizeof(*layer));
+  if(i + 1 < SIMPLET_METRICS_MAX_LAYERS && !(layer->name = simplet_copy_string(name)))
+    return NULL;
+  metrics.layers_length++;
+  return layer;
+}
+
+// Add a finished render's stats, and the time it spent on each layer, to the
+// totals in one step, so drawing a layer never waits on the lock. Only
+// renders that succeeded are added to the latency histograms.
+void
+simplet_metrics_add_render(simplet_render_t *render){
+  simplet_status_t status = render->error.status;
+  pthread_mutex_lock(&lock);
+  if(status <= SIMPLET_OK) metrics.renders[status]++;
+  if(status == SIMPLET_OK) {
+    int zoom = render->zoom >= 0 && render->zoom < SIMPLET_METRICS_ZOOMS
+      ? render->zoom : SIMPLET_METRICS_ZOOMS;
+    observe(&metrics.zooms[zoom], render->stats.total_time);
+  }
+  for(unsigned int i = 0; i < render->layer_stats_length; i++){
+    simplet_layer_stats_t *stats = &render->layer_stats[i];
+    layer_t *layer;
+    if((layer = find_layer(stats->name))) {
+      observe(&layer->latency, stats->seconds);
+      layer->queries += stats->queries;
+    }
+  }
+  metrics.bytes_encoded += render->stats.bytes_encoded;
+  metrics.features_read += render->stats.features_read;
+  metrics.labels_placed += render->stats.labels_placed;
+  pthread_mutex_unlock(&lock);
+}
+
+// A growing string of exposition text.
+typedef struct {
+  char *data;
+  size_t length;
+  size_t size;
+  int failed;
+} buffer_t;
+
+// Append printf style output to buffer, remembering if memory ran out.
+static void
+append(buffer_t *buffer, const char *format, ...){
+  if(buffer->failed) return;
+
+  va_list args;
+  va_start(args, format);
+  int needed = vsnprintf(buffer->data + buffer->length, buffer->size - buffer->length, format, args);
+  va_end(args);
+  if(needed < 0) {
+    buffer->failed = 1;
+    return;
+  }
+
+  if(buffer->length + needed >= buffer->size) {
+    size_t size = buffer->size;
+    while(buffer->length + needed >= size) size *= 2;
+    char *data;
+    if(!(data = simplet_realloc(buffer->data, size))) {
+      buffer->failed = 1;
+      return;
+    }
+    buffer->data = data;
+    buffer->size = size;
+
+    va_start(args, format);
+    vsnprintf(buffer->data + buffer->length, buffer->size - buffer->length, format, args);
+    va_end(args);
+  }
+  buffer->length += needed;
+}
+
+// Append the start of a sample of metric name, up to the end of its label
+// value, escaped as the exposition format requires.
+static void
+append_sample(buffer_t *buffer, const char *name, const char *label, const char *value){
+  append(buffer, "%s{%s=\"", name, label);
+  for(; *value; value++){
+    if(*value == '\\')
+      append(buffer, "\\\\");
+    else if(*value == '"')
+      append(buffer, "\\\"");
+    else if(*value == '\n')
+      append(buffer, "\\n");
+    else
+      append(buffer, "%c", *value);
+  }
+  append(buffer, "\"");
+}
+
+// Append a metric's help and type lines.
+static void
+append_header(buffer_t *buffer, const char *name, const char *type, const char *help){
+  append(buffer, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Append the samples of a histogram for the series with label set to value.
+static void
+append_histogram(buffer_t *buffer, const char *name, const char *label, const char *value,
+  histogram_t *histogram){
+  char bucket[64], sum[64], count[64];
+  snprintf(bucket, sizeof(bucket), "%s_bucket", name);
+  snprintf(sum, sizeof(sum), "%s_sum", name);
+  snprintf(count, sizeof(count), "%s_count", name);
+
+  unsigned long total = 0;
+  for(unsigned int i = 0; i < SIMPLET_METRICS_BUCKETS; i++){
+    total += histogram->buckets[i];
+    append_sample(buffer, bucket, label, value);
+    append(buffer, ",le=\"%g\"} %lu\n", bounds[i], total);
+  }
+  append_sample(buffer, bucket, label, value);
+  append(buffer, ",le=\"+Inf\"} %lu\n", histogram->count);
+  append_sample(buffer, sum, label, value);
+  append(buffer, "} %.9g\n", histogram->sum);
+  append_sample(buffer, count, label, value);
+  append(buffer, "} %lu\n", histogram->count);
+}
+
+// Write every metric in the Prometheus text exposition format to a new
+// string in text, which must be freed with simplet_free. Layers are labeled
+// with their name, see simplet_layer_set_name. Returns SIMPLET_OOM on failure.
+simplet_status_t
+simplet_metrics_to_prometheus(char **text){
+  buffer_t buffer = { NULL, 0, 4096, 0 };
+  if(!(buffer.data = simplet_malloc(buffer.size)))
+    return SIMPLET_OOM;
+  buffer.data[0] = '\0';
+
+  pthread_mutex_lock(&lock);
+  append_header(&buffer, "simplet_render_seconds", "histogram",
+    "Time taken by successful renders by zoom level.");
+  for(unsigned int i = 0; i <= SIMPLET_METRICS_ZOOMS; i++){
+    if(!metrics.zooms[i].count) continue;
+    char zoom[16];
+    if(i < SIMPLET_METRICS_ZOOMS)
+      snprintf(zoom, sizeof(zoom), "%u", i);
+    else
+      snprintf(zoom, sizeof(zoom), "other");
+    append_histogram(&buffer, "simplet_render_seconds", "zoom", zoom, &metrics.zooms[i]);
+  }
+
+  append_header(&buffer, "simplet_renders_total", "counter", "Renders finished by status.");
+  for(unsigned int i = 0; i <= SIMPLET_OK; i++){
+    append_sample(&buffer, "simplet_renders_total", "status", statuses[i]);
+    append(&buffer, "} %lu\n", metrics.renders[i]);
+  }
+
+  append_header(&buffer, "simplet_layer_seconds", "histogram",
+    "Time taken opening and drawing each layer.");
+  for(unsigned int i = 0; i < metrics.layers_length; i++){
+    layer_t *layer = &metrics.layers[i];
+    append_histogram(&buffer, "simplet_layer_seconds", "layer",
+      layer->name ? layer->name : "other", &layer->latency);
+  }
+
+  append_header(&buffer, "simplet_layer_queries_total", "counter",
+    "Queries run against each layer.");
+  for(unsigned int i = 0; i < metrics.layers_length; i++){
+    layer_t *layer = &metrics.layers[i];
+    append_sample(&buffer, "simplet_layer_queries_total", "layer",
+      layer->name ? layer->name : "other");
+    append(&buffer, "} %lu\n", layer->queries);
+  }
+
+  append_header(&buffer, "simplet_encoded_bytes_total", "counter", "Bytes of png written.");
+  append(&buffer, "simplet_encoded_bytes_total %lu\n", metrics.bytes_encoded);
+  append_header(&buffer, "simplet_features_read_total", "counter", "Features read from datasources.");
+  append(&buffer, "simplet_features_read_total %lu\n", metrics.features_read);
+  append_header(&buffer, "simplet_labels_placed_total", "counter", "Labels placed on tiles.");
+  append(&buffer, "simplet_labels_placed_total %lu\n", metrics.labels_placed);
+  pthread_mutex_unlock(&lock);
+
+  // The caches keep their own counts.
+  unsigned long hits[2], misses[2];
+  const char *caches[2] = { "anchor", "shape" };
+  simplet_anchor_cache_get_counts(&hits[0], &misses[0]);
+  simplet_shape_cache_get_counts(&hits[1], &misses[1]);
+
+  append_header(&buffer, "simplet_cache_hits_total", "counter", "Cache lookups that found an entry.");
+  for(int i = 0; i < 2; i++){
+    append_sample(&buffer, "simplet_cache_hits_total", "cache", caches[i]);
+    append(&buffer, "} %lu\n", hits[i]);
+  }
+  append_header(&buffer, "simplet_cache_misses_total", "counter", "Cache lookups that missed.");
+  for(int i = 0; i < 2; i++){
+    append_sample(&buffer, "simplet_cache_misses_total", "cache", caches[i]);
+    append(&buffer, "} %lu\n", misses[i]);
+  }
+  append_header(&buffer, "simplet_cache_hit_ratio", "gauge", "Share of cache lookups that hit.");
+  for(int i = 0; i < 2; i++){
+    append_sample(&buffer, "simplet_cache_hit_ratio", "cache", caches[i]);
+    append(&buffer, "} %g\n", hits[i] + misses[i] ? (double) hits[i] / (hits[i] + misses[i]) : 0);
+  }
+
+  if(buffer.failed) {
+    simplet_free(buffer.data);
+    return SIMPLET_OOM;
+  }
+  *text = buffer.data;
+  return SIMPLET_OK;
+}
@@ -0,0 +1,27 @@
+#ifndef _SIMPLE_TILES_METRICS_H
+#define _SIMPLE_TILES_METRICS_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Render latencies are histogrammed by zoom levels below this, deeper zooms
+// and renders with custom bounds share one more series.
+#define SIMPLET_METRICS_ZOOMS 24
+
+// Number of latency buckets, not counting +Inf.
+#define SIMPLET_METRICS_BUCKETS 11
+
+void
+simplet_metrics_add_render(simplet_render_t *render);
+
+simplet_status_t
+simplet_metrics_to_prometheus(char **text);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
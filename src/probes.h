@@ -0,0 +1,40 @@
+#ifndef _SIMPLE_TILES_PROBES_H
+#define _SIMPLE_TILES_PROBES_H
+
+// Static tracing probes at the hot points of a render, for bpftrace, perf,
+// SystemTap and the like to attach to. They are compiled in when the library
+// is built with -DSIMPLET_USDT, and each costs a nop until something attaches.
+// Otherwise they, and their arguments, compile away entirely, so arguments
+// must not have side effects.
+//
+// The probes, all in the simple_tiles provider, are:
+//
+//   render__start(zoom, width, height)
+//   render__done(zoom, status, microseconds)
+//   layer__start(zoom, name)
+//   layer__done(zoom, name, status)
+//   query__start(zoom, sql)
+//   query__done(zoom, sql)
+//   feature__dispatch(zoom, geometry type)
+//   label__accept(x, y)
+//   label__reject(x, y)
+//   encode__start(zoom)
+//   encode__done(zoom, status, microseconds)
+
+#ifdef SIMPLET_USDT
+
+#include <sys/sdt.h>
+
+#define SIMPLET_PROBE1(name, a) DTRACE_PROBE1(simple_tiles, name, a)
+#define SIMPLET_PROBE2(name, a, b) DTRACE_PROBE2(simple_tiles, name, a, b)
+#define SIMPLET_PROBE3(name, a, b, c) DTRACE_PROBE3(simple_tiles, name, a, b, c)
+
+#else
+
+#define SIMPLET_PROBE1(name, a) do {} while(0)
+#define SIMPLET_PROBE2(name, a, b) do {} while(0)
+#define SIMPLET_PROBE3(name, a, b, c) do {} while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "render.h"
+#include "error.h"
+#include "map.h"
+#include "layer.h"
+#include "style.h"
+#include "bounds.h"
+#include "list.h"
+#include "text.h"
+#include "labels.h"
+#include "arena.h"
+#include "util.h"
+#include "trace.h"
+#include "probes.h"
+#include "metrics.h"
+#include "alloc.h"
+
+// Add error reporting to simplet_render_t.
+SIMPLET_ERROR_FUNC(render_t)
+
+// Initialize render to draw map with the map's own bounds, size and zoom.
+// The map isn't modified while rendering, and the only allocation is a copy
+// of the map's spatial reference, which OGR doesn't allow threads to share.
+// Release the render with simplet_render_release.
+simplet_status_t
+simplet_render_init(simplet_render_t *render, simplet_map_t *map){
+  memset(render, 0, sizeof(*render));
+  render->error.status = SIMPLET_OK;
+  render->map    = map;
+  render->width  = map->width;
+  render->height = map->height;
+  render->zoom   = map->zoom;
+
+  if(map->bounds)
+    render->bounds = *map->bounds;
+  else
+    simplet_bounds_init(&render->bounds);
+
+  render->labels = simplet_labels_find(map->labels, render);
+
+  if(map->proj && !(render->proj = OSRClone(map->proj)))
+    return set_error(render, SIMPLET_OGR_ERR, "could not copy spatial ref");
+
+  return SIMPLET_OK;
+}
+
+// Free the memory held by a render.
+void
+simplet_render_release(simplet_render_t *render){
+  if(render->proj)
+    OSRRelease(render->proj);
+  if(render->arena)
+    simplet_arena_free(render->arena);
+  simplet_free(render->layer_stats);
+  render->proj  = NULL;
+  render->arena = NULL;
+  render->layer_stats = NULL;
+  render->layer_stats_length = render->layer_stats_size = 0;
+}
+
+// Record the time spent on a layer named name and the queries run there,
+// for the metrics. Figures are dropped when out of memory.
+void
+simplet_render_add_layer_stats(simplet_render_t *render, const char *name,
+  double seconds, unsigned long queries){
+  if(render->layer_stats_length == render->layer_stats_size) {
+    unsigned int size = render->layer_stats_size ? render->layer_stats_size * 2 : 8;
+    simplet_layer_stats_t *layer_stats;
+    if(!(layer_stats = simplet_realloc(render->layer_stats, size * sizeof(*layer_stats))))
+      return;
+    render->layer_stats      = layer_stats;
+    render->layer_stats_size = size;
+  }
+
+  simplet_layer_stats_t *stats = &render->layer_stats[render->layer_stats_length++];
+  stats->name    = name;
+  stats->seconds = seconds;
+  stats->queries = queries;
+}
+
+// Set the bounds to render in the map's projection.
+simplet_status_t
+simplet_render_set_bounds(simplet_render_t *render, double maxx, double maxy, double minx, double miny){
+  simplet_bounds_init(&render->bounds);
+  simplet_bounds_extend(&render->bounds, maxx, maxy);
+  simplet_bounds_extend(&render->bounds, minx, miny);
+  render->zoom = -1;
+  render->labels = NULL;
+  return SIMPLET_OK;
+}
+
+// Set the size of the rendered image.
+void
+simplet_render_set_size(simplet_render_t *render, unsigned int width, unsigned int height){
+  render->width  = width;
+  render->height = height;
+  render->labels = simplet_labels_find(render->map->labels, render);
+}
+
+// Render a slippy map tile. Unlike simplet_map_set_slippy this doesn't change
+// the projection, so the map has to use SIMPLET_MERCATOR already.
+simplet_status_t
+simplet_render_set_slippy(simplet_render_t *render, unsigned int x, unsigned int y, unsigned int z){
+  if(!render->map->mercator)
+    return set_error(render, SIMPLET_ERR, "slippy tiles need a SIMPLET_MERCATOR map");
+
+  simplet_render_set_size(render, SIMPLET_SLIPPY_SIZE, SIMPLET_SLIPPY_SIZE);
+
+  double zfactor, length, origin;
+  zfactor = pow(2.0, z);
+  length  = SIMPLET_MERC_LENGTH / zfactor;
+  origin  = SIMPLET_MERC_LENGTH / 2;
+
+  simplet_render_set_bounds(render, (x + 1) * length - origin,
+                                    origin - (y + 1) * length,
+                                    x * length - origin,
+                                    origin - y * length);
+  render->zoom = z;
+  render->labels = simplet_labels_find(render->map->labels, render);
+  return SIMPLET_OK;
+}
+
+// Check if the render has everything it needs to draw.
+simplet_status_t
+simplet_render_is_valid(simplet_render_t *render){
+  // Does it have a previously set error?
+  if(render->error.status != SIMPLET_OK)
+    return SIMPLET_ERR;
+
+  // Does it have a projection?
+  if(!render->proj)
+    return SIMPLET_ERR;
+
+  // Does it have an area to draw?
+  if(!(render->bounds.width > 0 && render->bounds.height > 0))
+    return SIMPLET_ERR;
+
+  // Does it have a size?
+  if(!render->width || !render->height)
+    return SIMPLET_ERR;
+
+  // Does the map have at least one layer?
+  if(!simplet_list_get_length(render->map->layers))
+    return SIMPLET_ERR;
+
+  return SIMPLET_OK;
+}
+
+// Initialize the transformation matrix for transforming data source coordinates
+// into cairo coordinates. We only assume square maps, so we'll want to change this
+// at some point.
+void
+simplet_render_init_matrix(simplet_render_t *render, cairo_matrix_t *mat){
+  simplet_bounds_t *bounds = &render->bounds;
+  cairo_matrix_init(mat, 1, 0, 0, -1, 0, 0);
+  cairo_matrix_translate(mat, 0, render->height * -1.0);
+  cairo_matrix_scale(mat, render->width / bounds->width, render->width / bounds->width);
+  cairo_matrix_translate(mat, -bounds->nw.x, -bounds->se.y);
+}
+
+// Set an error on the render, layers and filters report rendering errors
+// here rather than on themselves so the map stays untouched.
+simplet_status_t
+simplet_render_set_error(simplet_render_t *render, simplet_status_t status, const char *msg){
+  return set_error(render, status, msg);
+}
+
+// Check the error status of the render.
+simplet_status_t
+simplet_render_get_status(simplet_render_t *render){
+  return render->error.status;
+}
+
+// Clear the render's error, so a render kept between tiles can draw the next
+// tile after one fails.
+void
+simplet_render_reset(simplet_render_t *render){
+  render->error.status = SIMPLET_OK;
+  render->error.msg[0] = '\0';
+}
+
+// Return a human readable reference to the error message stored on the render.
+const char*
+simplet_render_status_to_string(simplet_render_t *render){
+  return (const char*) render->error.msg;
+}
+
+// Build a rendering context to draw the map on.
+static cairo_surface_t *
+build_surface(simplet_render_t *render){
+  simplet_map_t *map = render->map;
+  memset(&render->stats, 0, sizeof(render->stats));
+  render->layer_stats_length = 0;
+  SIMPLET_PROBE3(render__start, render->zoom, render->width, render->height);
+
+  // Check if the render is valid.
+  if(simplet_render_is_valid(render) == SIMPLET_ERR) {
+    if(render->error.status == SIMPLET_OK)
+      set_error(render, SIMPLET_ERR, "map isn't valid for rendering");
+    return NULL;
+  }
+
+  // Labels and other objects that don't outlive the render come from an
+  // arena that is kept for the next render.
+  if(!render->arena && !(render->arena = simplet_arena_new(SIMPLET_ARENA_BLOCK_SIZE))) {
+    set_error(render, SIMPLET_OOM, "out of memory creating render arena");
+    return NULL;
+  }
+
+  // Create a cairo surface to draw on.
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+      render->width, render->height);
+
+  if(cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+    set_error(render, SIMPLET_CAIRO_ERR, cairo_status_to_string(cairo_surface_status(surface)));
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+
+  cairo_t *ctx = cairo_create(surface);
+
+  // Paint the background color.
+  if(map->bgcolor) simplet_style_paint(ctx, map->bgcolor);
+
+  simplet_listiter_t iter;
+  simplet_list_iter_init(map->layers, &iter);
+  simplet_layer_t *layer;
+
+  cairo_t *litho_ctx = cairo_create(surface);
+
+  // Set up a map-wide text structure.
+  simplet_lithograph_t *litho = simplet_lithograph_new(litho_ctx);
+  litho->arena = render->arena;
+  litho->stats = &render->stats;
+  litho->saturation = SIMPLET_LABEL_SATURATION;
+  simplet_lithograph_set_extent(litho, render->width, render->height, simplet_map_get_buffer(map));
+
+  // Set a sensible default.
+  simplet_style_line_join(litho_ctx, "round");
+
+  // Iterate through and draw all the layers on the cairo context.
+  while((layer = simplet_list_next(&iter)))
+    if(simplet_layer_process(layer, render, litho, ctx) != SIMPLET_OK)
+      break;
+
+  simplet_lithograph_free(litho);
+  simplet_arena_reset(render->arena);
+  cairo_destroy(ctx);
+  cairo_destroy(litho_ctx);
+  return surface;
+}
+
+// Free the surface we've created and finish the render's stats, encoding
+// started at encode_start and the render at start, and add them to the
+// process wide metrics.
+static void
+close_surface(simplet_render_t *render, cairo_surface_t *surface, double start, double encode_start){
+  cairo_surface_destroy(surface);
+  double now = simplet_time_now();
+  render->stats.encode_time = now - encode_start;
+  render->stats.total_time  = now - start;
+  SIMPLET_PROBE3(encode__done, render->zoom, render->error.status, (long) (render->stats.encode_time * 1e6));
+  SIMPLET_PROBE3(render__done, render->zoom, render->error.status, (long) (render->stats.total_time * 1e6));
+  simplet_trace_end(render, "render", "encode", NULL, encode_start);
+  simplet_trace_end(render, "render", "render", NULL, start);
+  simplet_metrics_add_render(render);
+}
+
+// Finish a render that failed before it had a surface to encode, which
+// started at start, and add it to the process wide metrics.
+static simplet_status_t
+abandon_render(simplet_render_t *render, double start){
+  render->stats.total_time = simplet_time_now() - start;
+  SIMPLET_PROBE3(render__done, render->zoom, render->error.status, (long) (render->stats.total_time * 1e6));
+  simplet_metrics_add_render(render);
+  return render->error.status;
+}
+
+// Copy the stats of the last render into stats.
+void
+simplet_render_get_stats(simplet_render_t *render, simplet_stats_t *stats){
+  *stats = render->stats;
+}
+
+// Passes the png on to the caller's callback, counting its size.
+typedef struct {
+  simplet_render_t *render;
+  cairo_write_func_t cb;
+  void *closure;
+} counter_t;
+
+// Count a chunk of png and pass it on.
+static cairo_status_t
+count_bytes(void *closure, const unsigned char *data, unsigned int length){
+  counter_t *counter = closure;
+  counter->render->stats.bytes_encoded += length;
+  return counter->cb(counter->closure, data, length);
+}
+
+// Encode surface as a png and emit it to cb.
+static void
+encode(simplet_render_t *render, cairo_surface_t *surface, cairo_write_func_t cb, void *closure){
+  SIMPLET_PROBE1(encode__start, render->zoom);
+  counter_t counter = { render, cb, closure };
+  cairo_status_t status;
+  if((status = cairo_surface_write_to_png_stream(surface, count_bytes, &counter)) != CAIRO_STATUS_SUCCESS)
+    set_error(render, SIMPLET_CAIRO_ERR, cairo_status_to_string(status));
+}
+
+// Write a chunk of png to the FILE in closure.
+static cairo_status_t
+write_file(void *closure, const unsigned char *data, unsigned int length){
+  return fwrite(data, 1, length, closure) == length ? CAIRO_STATUS_SUCCESS : CAIRO_STATUS_WRITE_ERROR;
+}
+
+// Render and emit a stream of png chunks to closure.
+simplet_status_t
+simplet_render_to_stream(simplet_render_t *render, void *stream,
+  cairo_status_t (*cb)(void *closure, const unsigned char *data, unsigned int length)){
+  cairo_surface_t *surface;
+  double start = simplet_time_now();
+  if(!(surface = build_surface(render)))
+    return abandon_render(render, start);
+
+  double encode_start = simplet_time_now();
+  encode(render, surface, cb, stream);
+  close_surface(render, surface, start, encode_start);
+  return render->error.status;
+}
+
+// Render to a png file on disk.
+simplet_status_t
+simplet_render_to_png(simplet_render_t *render, const char *path){
+  cairo_surface_t *surface;
+  double start = simplet_time_now();
+  if(!(surface = build_surface(render)))
+    return abandon_render(render, start);
+
+  double encode_start = simplet_time_now();
+  FILE *file;
+  if(!(file = fopen(path, "wb"))) {
+    set_error(render, SIMPLET_CAIRO_ERR, cairo_status_to_string(CAIRO_STATUS_WRITE_ERROR));
+  } else {
+    encode(render, surface, write_file, file);
+    if(fclose(file) && render->error.status == SIMPLET_OK)
+      set_error(render, SIMPLET_CAIRO_ERR, cairo_status_to_string(CAIRO_STATUS_WRITE_ERROR));
+  }
+
+  close_surface(render, surface, start, encode_start);
+  return render->error.status;
+}
@@ -0,0 +1,61 @@
+#ifndef _SIMPLE_TILES_RENDER_H
+#define _SIMPLE_TILES_RENDER_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+simplet_status_t
+simplet_render_init(simplet_render_t *render, simplet_map_t *map);
+
+void
+simplet_render_release(simplet_render_t *render);
+
+simplet_status_t
+simplet_render_set_bounds(simplet_render_t *render, double maxx, double maxy, double minx, double miny);
+
+void
+simplet_render_set_size(simplet_render_t *render, unsigned int width, unsigned int height);
+
+simplet_status_t
+simplet_render_set_slippy(simplet_render_t *render, unsigned int x, unsigned int y, unsigned int z);
+
+simplet_status_t
+simplet_render_is_valid(simplet_render_t *render);
+
+void
+simplet_render_init_matrix(simplet_render_t *render, cairo_matrix_t *mat);
+
+simplet_status_t
+simplet_render_set_error(simplet_render_t *render, simplet_status_t status, const char *msg);
+
+simplet_status_t
+simplet_render_get_status(simplet_render_t *render);
+
+void
+simplet_render_reset(simplet_render_t *render);
+
+const char*
+simplet_render_status_to_string(simplet_render_t *render);
+
+void
+simplet_render_get_stats(simplet_render_t *render, simplet_stats_t *stats);
+
+void
+simplet_render_add_layer_stats(simplet_render_t *render, const char *name,
+  double seconds, unsigned long queries);
+
+simplet_status_t
+simplet_render_to_png(simplet_render_t *render, const char *path);
+
+simplet_status_t
+simplet_render_to_stream(simplet_render_t *render, void *stream,
+  cairo_status_t (*cb)(void *closure, const unsigned char *data, unsigned int length));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "shape.h"
+#include "alloc.h"
+
+// Number of hash buckets, a power of two.
+#define SIMPLET_SHAPE_BUCKETS 4096
+
+// The process wide cache of shaped labels. Shapes are kept in a hash table
+// for lookups and a list ordered from most to least recently used so the
+// oldest can be dropped once the cache is full.
+static struct {
+  pthread_mutex_t lock;
+  simplet_shape_t *buckets[SIMPLET_SHAPE_BUCKETS];
+  simplet_shape_t *head;
+  simplet_shape_t *tail;
+  unsigned int length;
+  unsigned int size;
+  unsigned long hits;
+  unsigned long misses;
+} cache = { PTHREAD_MUTEX_INITIALIZER, { NULL }, NULL, NULL, 0, SIMPLET_SHAPE_CACHE_SIZE, 0, 0 };
+
+// Hash a key with djb2.
+static unsigned long
+hash_key(const char *key){
+  unsigned long hash = 5381;
+  int c;
+  while((c = *key++))
+    hash = ((hash << 5) + hash) + c;
+  return hash;
+}
+
+// Free a shape and its glyphs.
+static void
+shape_free(simplet_shape_t *shape){
+  for(int i = 0; i < shape->runs_length; i++){
+    cairo_scaled_font_destroy(shape->runs[i].font);
+    simplet_free(shape->runs[i].glyphs);
+  }
+  simplet_free(shape->runs);
+  simplet_free(shape->key);
+  simplet_free(shape);
+}
+
+// Add a run of glyphs from a layout to the shape, returns 0 on failure.
+static int
+add_run(simplet_shape_t *shape, PangoGlyphItem *item, int x, int baseline){
+  PangoGlyphString *string = item->glyphs;
+  cairo_scaled_font_t *font = pango_cairo_font_get_scaled_font((PangoCairoFont *) item->item->analysis.font);
+  if(!font || !string->num_glyphs) return 1;
+
+  simplet_shape_run_t *runs;
+  if(!(runs = simplet_realloc(shape->runs, (shape->runs_length + 1) * sizeof(*runs))))
+    return 0;
+  shape->runs = runs;
+
+  simplet_shape_run_t *run = &shape->runs[shape->runs_length];
+  if(!(run->glyphs = simplet_malloc(string->num_glyphs * sizeof(*run->glyphs))))
+    return 0;
+
+  run->length = 0;
+  for(int i = 0; i < string->num_glyphs; i++){
+    PangoGlyphInfo *info = &string->glyphs[i];
+    if(info->glyph != PANGO_GLYPH_EMPTY && !(info->glyph & PANGO_GLYPH_UNKNOWN_FLAG)){
+      cairo_glyph_t *glyph = &run->glyphs[run->length++];
+      glyph->index = info->glyph;
+      glyph->x = (double) (x + info->geometry.x_offset) / PANGO_SCALE;
+      glyph->y = (double) (baseline + info->geometry.y_offset) / PANGO_SCALE;
+    }
+    x += info->geometry.width;
+  }
+
+  run->font = cairo_scaled_font_reference(font);
+  shape->runs_length++;
+  return 1;
+}
+
+// Shape text with Pango and copy out the glyphs, returns NULL on failure.
+static simplet_shape_t*
+shape_new(PangoContext *ctx, const char *text, simplet_compiled_styles_t *styles){
+  simplet_shape_t *shape;
+  if(!(shape = simplet_malloc(sizeof(*shape))))
+    return NULL;
+
+  memset(shape, 0, sizeof(*shape));
+
+  PangoLayout *layout = pango_layout_new(ctx);
+  pango_layout_set_text(layout, text, -1);
+  pango_layout_set_font_description(layout, styles->font_description);
+  if(styles->text_attributes)
+    pango_layout_set_attributes(layout, styles->text_attributes);
+  pango_layout_get_pixel_size(layout, &shape->width, &shape->height);
+
+  PangoLayoutIter *iter = pango_layout_get_iter(layout);
+  int ok = 1;
+  do {
+    PangoGlyphItem *item = pango_layout_iter_get_run_readonly(iter);
+    if(!item) continue;
+    PangoRectangle extents;
+    pango_layout_iter_get_run_extents(iter, NULL, &extents);
+    ok = add_run(shape, item, extents.x, pango_layout_iter_get_baseline(iter));
+  } while(ok && pango_layout_iter_next_run(iter));
+  pango_layout_iter_free(iter);
+  g_object_unref(layout);
+
+  if(!ok){
+    shape_free(shape);
+    return NULL;
+  }
+
+  return shape;
+}
+
+// Move a cached shape to the front of the recently used list. Called with
+// the lock held.
+static void
+touch(simplet_shape_t *shape){
+  if(cache.head == shape) return;
+  if(shape->prev) shape->prev->next = shape->next;
+  if(shape->next) shape->next->prev = shape->prev;
+  if(cache.tail == shape) cache.tail = shape->prev;
+  shape->prev = NULL;
+  shape->next = cache.head;
+  if(cache.head) cache.head->prev = shape;
+  cache.head = shape;
+  if(!cache.tail) cache.tail = shape;
+}
+
+// Remove a shape from the cache and drop the cache's reference. Called with
+// the lock held.
+static void
+evict(simplet_shape_t *shape){
+  simplet_shape_t **link = &cache.buckets[shape->hash & (SIMPLET_SHAPE_BUCKETS - 1)];
+  while(*link != shape) link = &(*link)->chain;
+  *link = shape->chain;
+
+  if(shape->prev) shape->prev->next = shape->next;
+  else cache.head = shape->next;
+  if(shape->next) shape->next->prev = shape->prev;
+  else cache.tail = shape->prev;
+
+  cache.length--;
+  if(!--shape->refcount) shape_free(shape);
+}
+
+// Find a shape in the cache and reference it. Called with the lock held.
+static simplet_shape_t*
+lookup(const char *key, unsigned long hash){
+  simplet_shape_t *shape = cache.buckets[hash & (SIMPLET_SHAPE_BUCKETS - 1)];
+  for(; shape; shape = shape->chain)
+    if(shape->hash == hash && !strcmp(shape->key, key)) {
+      touch(shape);
+      shape->refcount++;
+      return shape;
+    }
+  return NULL;
+}
+
+// Return the shape of text in the font and letter spacing of styles,
+// shaping it with ctx if it isn't cached. The shape is referenced and must be
+// released with simplet_shape_release. Returns NULL on failure.
+simplet_shape_t*
+simplet_shape_get(PangoContext *ctx, const char *text, simplet_compiled_styles_t *styles){
+  const char *font = styles->set & SIMPLET_STYLE_FONT ? styles->font : SIMPLET_DEFAULT_FONT;
+  int spacing = styles->set & SIMPLET_STYLE_LETTER_SPACING ? styles->letter_spacing : 0;
+
+  size_t length = strlen(font) + strlen(text) + 16;
+  char *key;
+  if(!(key = simplet_malloc(length)))
+    return NULL;
+  int written = snprintf(key, length, "%s\n%d\n%s", font, spacing, text);
+  unsigned long hash = hash_key(key);
+
+  simplet_shape_t *shape;
+  pthread_mutex_lock(&cache.lock);
+  if((shape = lookup(key, hash)))
+    cache.hits++;
+  else
+    cache.misses++;
+  pthread_mutex_unlock(&cache.lock);
+  if(shape) {
+    simplet_free(key);
+    return shape;
+  }
+
+  // Shape outside of the lock so other threads can keep using the cache.
+  simplet_shape_t *shaped;
+  if(!(shaped = shape_new(ctx, text, styles))) {
+    simplet_free(key);
+    return NULL;
+  }
+  shaped->key  = key;
+  shaped->text = key + written - strlen(text);
+  shaped->hash = hash;
+
+  pthread_mutex_lock(&cache.lock);
+  // Another thread may have shaped the same label in the meantime.
+  if((shape = lookup(key, hash))) {
+    pthread_mutex_unlock(&cache.lock);
+    shape_free(shaped);
+    return shape;
+  }
+
+  // One reference for the cache and one for the caller.
+  shaped->refcount = cache.size ? 2 : 1;
+  if(cache.size) {
+    simplet_shape_t **bucket = &cache.buckets[hash & (SIMPLET_SHAPE_BUCKETS - 1)];
+    shaped->chain = *bucket;
+    *bucket = shaped;
+    touch(shaped);
+    cache.length++;
+    while(cache.length > cache.size)
+      evict(cache.tail);
+  }
+  pthread_mutex_unlock(&cache.lock);
+
+  return shaped;
+}
+
+// Drop a reference to a shape.
+void
+simplet_shape_release(simplet_shape_t *shape){
+  pthread_mutex_lock(&cache.lock);
+  int last = !--shape->refcount;
+  pthread_mutex_unlock(&cache.lock);
+  if(last) shape_free(shape);
+}
+
+// Return the text a shape was shaped from.
+const char*
+simplet_shape_get_text(simplet_shape_t *shape){
+  return shape->text;
+}
+
+// Glyphs offset at a time by place_glyphs.
+#define SIMPLET_GLYPH_CHUNK 64
+
+// Offset a shape's glyphs to x, y and either draw them or add them to the
+// current path. Glyphs are copied SIMPLET_GLYPH_CHUNK at a time into a buffer
+// on the stack, since labels are drawn far too often to allocate for each.
+static void
+place_glyphs(simplet_shape_t *shape, cairo_t *ctx, double x, double y, int show){
+  cairo_glyph_t glyphs[SIMPLET_GLYPH_CHUNK];
+  for(int i = 0; i < shape->runs_length; i++){
+    simplet_shape_run_t *run = &shape->runs[i];
+    if(!run->length) continue;
+
+    cairo_set_scaled_font(ctx, run->font);
+    for(int start = 0; start < run->length; start += SIMPLET_GLYPH_CHUNK){
+      int length = run->length - start;
+      if(length > SIMPLET_GLYPH_CHUNK) length = SIMPLET_GLYPH_CHUNK;
+
+      for(int j = 0; j < length; j++){
+        glyphs[j] = run->glyphs[start + j];
+        glyphs[j].x += x;
+        glyphs[j].y += y;
+      }
+
+      if(show)
+        cairo_show_glyphs(ctx, glyphs, length);
+      else
+        cairo_glyph_path(ctx, glyphs, length);
+    }
+  }
+}
+
+// Add the outlines of a shape's glyphs to the current path with its top left
+// corner at x, y in device space.
+void
+simplet_shape_path(simplet_shape_t *shape, cairo_t *ctx, double x, double y){
+  place_glyphs(shape, ctx, x, y, 0);
+}
+
+// Draw a shape with the current source and its top left corner at x, y in
+// device space. Unlike filling simplet_shape_path this uses cairo's cache of
+// rendered glyphs.
+void
+simplet_shape_show(simplet_shape_t *shape, cairo_t *ctx, double x, double y){
+  place_glyphs(shape, ctx, x, y, 1);
+}
+
+// Set the number of shapes the cache keeps, a size of 0 turns the cache off.
+void
+simplet_shape_cache_set_size(unsigned int size){
+  pthread_mutex_lock(&cache.lock);
+  cache.size = size;
+  while(cache.length > cache.size)
+    evict(cache.tail);
+  pthread_mutex_unlock(&cache.lock);
+}
+
+// Drop every shape from the cache.
+void
+simplet_shape_cache_clear(){
+  pthread_mutex_lock(&cache.lock);
+  while(cache.tail)
+    evict(cache.tail);
+  pthread_mutex_unlock(&cache.lock);
+}
+
+// Count the lookups that found a cached shape, and those that had to shape
+// the label, since the process started.
+void
+simplet_shape_cache_get_counts(unsigned long *hits, unsigned long *misses){
+  pthread_mutex_lock(&cache.lock);
+  *hits   = cache.hits;
+  *misses = cache.misses;
+  pthread_mutex_unlock(&cache.lock);
+}
@@ -0,0 +1,65 @@
+#ifndef _SIMPLE_TILES_SHAPE_H
+#define _SIMPLE_TILES_SHAPE_H
+
+#include "types.h"
+#include "style.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of shaped labels kept by default.
+#define SIMPLET_SHAPE_CACHE_SIZE 4096
+
+// Glyphs in a single font, positioned relative to the top left of the label.
+typedef struct {
+  cairo_scaled_font_t *font;
+  cairo_glyph_t *glyphs;
+  int length;
+} simplet_shape_run_t;
+
+// A label that has been shaped by Pango. Shapes are shared between renders
+// and threads and must be treated as read only.
+typedef struct simplet_shape_t {
+  char *key;
+  const char *text; // the label's text, the tail of key
+  unsigned long hash;
+  unsigned int refcount;
+  simplet_shape_run_t *runs;
+  int runs_length;
+  int width;
+  int height;
+  struct simplet_shape_t *chain;
+  struct simplet_shape_t *prev;
+  struct simplet_shape_t *next;
+} simplet_shape_t;
+
+simplet_shape_t*
+simplet_shape_get(PangoContext *ctx, const char *text, simplet_compiled_styles_t *styles);
+
+void
+simplet_shape_release(simplet_shape_t *shape);
+
+const char*
+simplet_shape_get_text(simplet_shape_t *shape);
+
+void
+simplet_shape_path(simplet_shape_t *shape, cairo_t *ctx, double x, double y);
+
+void
+simplet_shape_show(simplet_shape_t *shape, cairo_t *ctx, double x, double y);
+
+void
+simplet_shape_cache_set_size(unsigned int size);
+
+void
+simplet_shape_cache_clear();
+
+void
+simplet_shape_cache_get_counts(unsigned long *hits, unsigned long *misses);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
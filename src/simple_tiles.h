@@ -1,6 +1,10 @@
 #ifndef _SIMPLE_TILES_H
 #define _SIMPLE_TILES_H
 #include "map.h"
+#include "render.h"
+#include "alloc.h"
+#include "trace.h"
+#include "metrics.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -4,6 +4,8 @@
 #include "map.h"
 #include "style.h"
 #include "util.h"
+#include "expr.h"
+#include "alloc.h"
 
 // Small structure to track callbacks by key.
 typedef struct simplet_styledef_t {
@@ -16,48 +18,80 @@ typedef struct simplet_styledef_t {
 // Set up user data functions on simplet_style_t.
 SIMPLET_HAS_USER_DATA(style)
 
-// Set the current drawing color for the ctx. Accepts either
-// #xxxxxx or #xxxxxxaa formatted colors.
+// Parse either #xxxxxx or #xxxxxxaa formatted colors into color.
 static void
-set_color(void *ct, const char *arg){
-  cairo_t *ctx = ct;
+compile_color(const char *arg, simplet_color_t *color){
   unsigned int r, g, b, a, count;
   count = simplet_parse_color(arg, &r, &g, &b, &a);
-  switch(count){
-  case 3:
-    cairo_set_source_rgb(ctx, r / SIMPLET_CCEIL, g / SIMPLET_CCEIL, b / SIMPLET_CCEIL);
-    break;
-  case 4:
-    cairo_set_source_rgba(ctx, r / SIMPLET_CCEIL, g / SIMPLET_CCEIL, b / SIMPLET_CCEIL,
-        a / SIMPLET_CCEIL);
-    break;
-  default:
+  color->valid = count == 3 || count == 4;
+  if(!color->valid)
     return;
-  }
+
+  color->r = r / SIMPLET_CCEIL;
+  color->g = g / SIMPLET_CCEIL;
+  color->b = b / SIMPLET_CCEIL;
+  color->a = count == 4 ? a / SIMPLET_CCEIL : 1.0;
+}
+
+// Set a previously parsed color as the current drawing color for the ctx.
+void
+simplet_set_compiled_color(cairo_t *ctx, simplet_color_t *color){
+  if(!color->valid)
+    return;
+  cairo_set_source_rgba(ctx, color->r, color->g, color->b, color->a);
+}
+
+// Set the current drawing color for the ctx. Accepts either
+// #xxxxxx or #xxxxxxaa formatted colors.
+static void
+set_color(void *ct, const char *arg){
+  simplet_color_t color;
+  compile_color(arg, &color);
+  simplet_set_compiled_color(ct, &color);
+}
+
+// Look up the cairo line join named by arg, returns 0 if arg is unknown.
+static int
+compile_line_join(const char *arg, cairo_line_join_t *join){
+  if(!strcmp("miter", arg))
+    *join = CAIRO_LINE_JOIN_MITER;
+  else if(!strcmp("round", arg))
+    *join = CAIRO_LINE_JOIN_ROUND;
+  else if(!strcmp("bevel", arg))
+    *join = CAIRO_LINE_JOIN_BEVEL;
+  else
+    return 0;
+  return 1;
+}
+
+// Look up the cairo line cap named by arg, returns 0 if arg is unknown.
+static int
+compile_line_cap(const char *arg, cairo_line_cap_t *cap){
+  if(!strcmp("butt", arg))
+    *cap = CAIRO_LINE_CAP_BUTT;
+  else if(!strcmp("round", arg))
+    *cap = CAIRO_LINE_CAP_ROUND;
+  else if(!strcmp("square", arg))
+    *cap = CAIRO_LINE_CAP_SQUARE;
+  else
+    return 0;
+  return 1;
 }
 
 // Set the line join on the ct.
 void
 simplet_style_line_join(void *ct, const char *arg){
-  cairo_t *ctx = ct;
-  if(!strcmp("miter", arg))
-    cairo_set_line_join(ctx, CAIRO_LINE_JOIN_MITER);
-  if(!strcmp("round", arg))
-    cairo_set_line_join(ctx, CAIRO_LINE_JOIN_ROUND);
-  if(!strcmp("bevel", arg))
-    cairo_set_line_join(ctx, CAIRO_LINE_JOIN_BEVEL);
+  cairo_line_join_t join;
+  if(compile_line_join(arg, &join))
+    cairo_set_line_join(ct, join);
 }
 
 // Set the ending line cap on the ct.
 static void
 line_cap(void *ct, const char *arg){
-  cairo_t *ctx = ct;
-  if(!strcmp("butt", arg))
-    cairo_set_line_cap(ctx, CAIRO_LINE_CAP_BUTT);
-  if(!strcmp("round", arg))
-    cairo_set_line_cap(ctx, CAIRO_LINE_CAP_ROUND);
-  if(!strcmp("square", arg))
-    cairo_set_line_cap(ctx, CAIRO_LINE_CAP_SQUARE);
+  cairo_line_cap_t cap;
+  if(compile_line_cap(arg, &cap))
+    cairo_set_line_cap(ct, cap);
 }
 
 // Paint an overlay color on the ct.
@@ -84,22 +118,26 @@ stroke(void *ct, const char *arg){
   cairo_stroke_preserve(ctx);
 }
 
-// Set the line weight on the ctx.
+// Set a line weight in pixels on the ctx.
 static void
-weight(void *ct, const char *arg){
-  cairo_t *ctx = ct;
-  double w = strtod(arg, NULL), y = 0;
+set_weight(cairo_t *ctx, double w){
+  double y = 0;
   cairo_device_to_user_distance(ctx, &w, &y);
   cairo_set_line_width(ctx, w);
 }
 
-// Set the letter spacing on for typsetting on a PangoLayout.
+// Set the line weight on the ctx.
 static void
-letter_spacing(void *ct, const char *arg){
+weight(void *ct, const char *arg){
+  set_weight(ct, strtod(arg, NULL));
+}
+
+// Set the letter spacing in pixels for typesetting on a PangoLayout.
+static void
+set_letter_spacing(PangoLayout *layout, int pixels){
   PangoAttribute *spacing;
-  if(!(spacing = pango_attr_letter_spacing_new(atoi(arg) * PANGO_SCALE))) return;
+  if(!(spacing = pango_attr_letter_spacing_new(pixels * PANGO_SCALE))) return;
 
-  PangoLayout *layout = ct;
   PangoAttrList *attrs = pango_layout_get_attributes(layout);
 
   // Create a new PangoAttrList if we don't already have one.
@@ -115,6 +153,12 @@ letter_spacing(void *ct, const char *arg){
   pango_attr_list_unref(attrs);
 }
 
+// Set the letter spacing on for typsetting on a PangoLayout.
+static void
+letter_spacing(void *ct, const char *arg){
+  set_letter_spacing(ct, atoi(arg));
+}
+
 
 // List of defined styles.
 simplet_styledef_t styleTable[] = {
@@ -136,17 +180,23 @@ const int STYLES_LENGTH = sizeof(styleTable) / sizeof(*styleTable);
 simplet_style_t*
 simplet_style_new(const char *key, const char *arg){
   simplet_style_t* style;
-  if(!(style = malloc(sizeof(*style))))
+  if(!(style = simplet_malloc(sizeof(*style))))
     return NULL;
 
-  style->key = simplet_copy_string(key);
-  style->arg = simplet_copy_string(arg);
+  style->key  = simplet_copy_string(key);
+  style->arg  = simplet_copy_string(arg);
+  style->expr = NULL;
 
   if(!(style->key && style->arg)){
-    free(style);
+    simplet_free(style->key);
+    simplet_free(style->arg);
+    simplet_free(style);
     return NULL;
   }
 
+  // Parse data driven values up front so rendering only evaluates them.
+  style->expr = simplet_expr_new(style->arg);
+
   return style;
 }
 
@@ -159,9 +209,11 @@ simplet_style_vfree(void *style){
 // Free a simplet_style_t
 void
 simplet_style_free(simplet_style_t* style){
-  free(style->key);
-  free(style->arg);
-  free(style);
+  if(style->expr)
+    simplet_expr_free(style->expr);
+  simplet_free(style->key);
+  simplet_free(style->arg);
+  simplet_free(style);
 }
 
 // Find a styledef in the styleTable.
@@ -198,19 +250,14 @@ simplet_apply_styles(void *ct, simplet_list_t* styles, ...){
 // because you won't have a whole ton of styles O(N) is okey-dokey.
 simplet_style_t*
 simplet_lookup_style(simplet_list_t *styles, const char *key){
-  simplet_listiter_t* iter;
-  if(!(iter = simplet_get_list_iter(styles)))
-    return NULL;
+  simplet_listiter_t iter;
+  simplet_list_iter_init(styles, &iter);
 
   simplet_style_t* style;
-  while((style = simplet_list_next(iter))){
-    // If we find the style that matches key.
-    if(!strcmp(key, style->key)) {
-      // Free the iterator and return the style.
-      simplet_list_iter_free(iter);
+  while((style = simplet_list_next(&iter)))
+    // If we find the style that matches key return it.
+    if(!strcmp(key, style->key))
       return style;
-    }
-  }
   return NULL;
 }
 
@@ -229,7 +276,11 @@ simplet_style_get_key(simplet_style_t *style, char **key){
 // Set a copy of arg in style.
 void
 simplet_style_set_arg(simplet_style_t *style, char *arg){
+  simplet_free(style->arg);
   style->arg = simplet_copy_string(arg);
+  if(style->expr)
+    simplet_expr_free(style->expr);
+  style->expr = style->arg ? simplet_expr_new(style->arg) : NULL;
 }
 
 // Set a copy of key in style.
@@ -237,3 +288,284 @@ void
 simplet_style_set_key(simplet_style_t *style, char *key){
   style->key = simplet_copy_string(key);
 }
+
+// Add a binding for a data driven style, returns the style's flag or 0 if
+// key can't be data driven or is already set.
+static unsigned int
+bind_expr(simplet_compiled_styles_t *compiled, const char *key, simplet_expr_t *expr){
+  simplet_style_flag_t flag;
+  if(!strcmp(key, "fill"))
+    flag = SIMPLET_STYLE_FILL;
+  else if(!strcmp(key, "stroke"))
+    flag = SIMPLET_STYLE_STROKE;
+  else if(!strcmp(key, "weight"))
+    flag = SIMPLET_STYLE_WEIGHT;
+  else if(!strcmp(key, "radius"))
+    flag = SIMPLET_STYLE_RADIUS;
+  else
+    return 0;
+
+  if(compiled->set & flag || compiled->bindings_length >= SIMPLET_MAX_BINDINGS)
+    return 0;
+
+  simplet_style_binding_t *binding = &compiled->bindings[compiled->bindings_length++];
+  binding->flag  = flag;
+  binding->expr  = expr;
+  binding->field = -1;
+  return flag;
+}
+
+// Parse the font and build the letter spacing attributes for labels once,
+// so placing a label only has to set its text.
+static void
+compile_text(simplet_compiled_styles_t *compiled){
+  const char *font = compiled->set & SIMPLET_STYLE_FONT ? compiled->font : SIMPLET_DEFAULT_FONT;
+  compiled->font_description = pango_font_description_from_string(font);
+
+  // Pango's cairo fontmap renders point sizes at 96 dpi.
+  int size;
+  if(compiled->font_description && (size = pango_font_description_get_size(compiled->font_description)))
+    compiled->font_pixels = (double) size / PANGO_SCALE *
+      (pango_font_description_get_size_is_absolute(compiled->font_description) ? 1.0 : 96.0 / 72.0);
+
+  if(!(compiled->set & SIMPLET_STYLE_LETTER_SPACING)) return;
+
+  PangoAttribute *spacing;
+  if(!(spacing = pango_attr_letter_spacing_new(compiled->letter_spacing * PANGO_SCALE))) return;
+  if(!(compiled->text_attributes = pango_attr_list_new())) {
+    pango_attribute_destroy(spacing);
+    return;
+  }
+  pango_attr_list_insert(compiled->text_attributes, spacing);
+}
+
+// Compile a list of styles into a simplet_compiled_styles_t. As with
+// simplet_lookup_style the first style for a key wins. String arguments for
+// text-field, font and text-priority are borrowed from the list, so compiled
+// styles must not outlive it. Release them with
+// simplet_release_compiled_styles, copies share the font description and
+// attributes and must not be released.
+void
+simplet_compile_styles(simplet_list_t *styles, simplet_compiled_styles_t *compiled){
+  memset(compiled, 0, sizeof(*compiled));
+
+  simplet_listiter_t iter;
+  simplet_list_iter_init(styles, &iter);
+
+  simplet_style_t *style;
+  while((style = simplet_list_next(&iter))){
+    const char *key = style->key, *arg = style->arg;
+    unsigned int flag = 0;
+
+    if(style->expr && (flag = bind_expr(compiled, key, style->expr))) {
+      compiled->set |= flag;
+      continue;
+    }
+
+    if(!strcmp(key, "fill") && !(compiled->set & SIMPLET_STYLE_FILL)) {
+      compile_color(arg, &compiled->fill);
+      flag = SIMPLET_STYLE_FILL;
+    } else if(!strcmp(key, "stroke") && !(compiled->set & SIMPLET_STYLE_STROKE)) {
+      compile_color(arg, &compiled->stroke);
+      flag = SIMPLET_STYLE_STROKE;
+    } else if(!strcmp(key, "color") && !(compiled->set & SIMPLET_STYLE_COLOR)) {
+      compile_color(arg, &compiled->color);
+      flag = SIMPLET_STYLE_COLOR;
+    } else if(!strcmp(key, "text-stroke-color") && !(compiled->set & SIMPLET_STYLE_TEXT_STROKE_COLOR)) {
+      compile_color(arg, &compiled->text_stroke_color);
+      flag = SIMPLET_STYLE_TEXT_STROKE_COLOR;
+    } else if(!strcmp(key, "weight") && !(compiled->set & SIMPLET_STYLE_WEIGHT)) {
+      compiled->weight = strtod(arg, NULL);
+      flag = SIMPLET_STYLE_WEIGHT;
+    } else if(!strcmp(key, "text-stroke-weight") && !(compiled->set & SIMPLET_STYLE_TEXT_STROKE_WEIGHT)) {
+      compiled->text_stroke_weight = strtod(arg, NULL);
+      flag = SIMPLET_STYLE_TEXT_STROKE_WEIGHT;
+    } else if(!strcmp(key, "radius") && !(compiled->set & SIMPLET_STYLE_RADIUS)) {
+      compiled->radius = strtod(arg, NULL);
+      flag = SIMPLET_STYLE_RADIUS;
+    } else if(!strcmp(key, "letter-spacing") && !(compiled->set & SIMPLET_STYLE_LETTER_SPACING)) {
+      compiled->letter_spacing = atoi(arg);
+      flag = SIMPLET_STYLE_LETTER_SPACING;
+    } else if(!strcmp(key, "line-join") && !(compiled->set & SIMPLET_STYLE_LINE_JOIN)) {
+      if(compile_line_join(arg, &compiled->line_join))
+        flag = SIMPLET_STYLE_LINE_JOIN;
+    } else if(!strcmp(key, "line-cap") && !(compiled->set & SIMPLET_STYLE_LINE_CAP)) {
+      if(compile_line_cap(arg, &compiled->line_cap))
+        flag = SIMPLET_STYLE_LINE_CAP;
+    } else if(!strcmp(key, "seamless")) {
+      flag = SIMPLET_STYLE_SEAMLESS;
+    } else if(!strcmp(key, "text-field") && !(compiled->set & SIMPLET_STYLE_TEXT_FIELD)) {
+      compiled->text_field = arg;
+      flag = SIMPLET_STYLE_TEXT_FIELD;
+    } else if(!strcmp(key, "font") && !(compiled->set & SIMPLET_STYLE_FONT)) {
+      compiled->font = arg;
+      flag = SIMPLET_STYLE_FONT;
+    } else if(!strcmp(key, "text-priority") && !(compiled->set & SIMPLET_STYLE_TEXT_PRIORITY)) {
+      compiled->text_priority = arg;
+      flag = SIMPLET_STYLE_TEXT_PRIORITY;
+    } else if(!strcmp(key, "text-limit") && !(compiled->set & SIMPLET_STYLE_TEXT_LIMIT)) {
+      compiled->text_limit = strtoul(arg, NULL, 10);
+      flag = SIMPLET_STYLE_TEXT_LIMIT;
+    }
+
+    compiled->set |= flag;
+  }
+
+  if(compiled->set & SIMPLET_STYLE_TEXT_FIELD)
+    compile_text(compiled);
+}
+
+// Free the text resources held by compiled styles.
+void
+simplet_release_compiled_styles(simplet_compiled_styles_t *compiled){
+  if(compiled->font_description)
+    pango_font_description_free(compiled->font_description);
+  if(compiled->text_attributes)
+    pango_attr_list_unref(compiled->text_attributes);
+  compiled->font_description = NULL;
+  compiled->text_attributes = NULL;
+}
+
+// The order compiled styles are applied in. This matches the order the
+// plotting and labeling code passes keys to simplet_apply_styles: strokes go
+// over fills, and text halos go under the text color.
+static const simplet_style_flag_t applyOrder[] = {
+  SIMPLET_STYLE_LINE_JOIN,
+  SIMPLET_STYLE_LINE_CAP,
+  SIMPLET_STYLE_WEIGHT,
+  SIMPLET_STYLE_TEXT_STROKE_WEIGHT,
+  SIMPLET_STYLE_FILL,
+  SIMPLET_STYLE_STROKE,
+  SIMPLET_STYLE_TEXT_STROKE_COLOR,
+  SIMPLET_STYLE_COLOR,
+  SIMPLET_STYLE_LETTER_SPACING
+};
+static const int APPLY_LENGTH = sizeof(applyOrder) / sizeof(*applyOrder);
+
+// Apply the compiled styles selected by mask to ct. Like the styleTable
+// callbacks, ct is a cairo_t for everything but letter-spacing, which expects
+// a PangoLayout.
+void
+simplet_apply_compiled_styles(void *ct, simplet_compiled_styles_t *compiled, unsigned int mask){
+  unsigned int todo = compiled->set & mask;
+  for(int i = 0; i < APPLY_LENGTH && todo; i++){
+    if(!(todo & applyOrder[i]))
+      continue;
+
+    switch(applyOrder[i]){
+      case SIMPLET_STYLE_LINE_JOIN:
+        cairo_set_line_join(ct, compiled->line_join);
+        break;
+      case SIMPLET_STYLE_LINE_CAP:
+        cairo_set_line_cap(ct, compiled->line_cap);
+        break;
+      case SIMPLET_STYLE_WEIGHT:
+        set_weight(ct, compiled->weight);
+        break;
+      case SIMPLET_STYLE_TEXT_STROKE_WEIGHT:
+        set_weight(ct, compiled->text_stroke_weight);
+        break;
+      case SIMPLET_STYLE_FILL:
+        simplet_set_compiled_color(ct, &compiled->fill);
+        cairo_fill_preserve(ct);
+        break;
+      case SIMPLET_STYLE_STROKE:
+        simplet_set_compiled_color(ct, &compiled->stroke);
+        cairo_stroke_preserve(ct);
+        break;
+      case SIMPLET_STYLE_TEXT_STROKE_COLOR:
+        simplet_set_compiled_color(ct, &compiled->text_stroke_color);
+        cairo_stroke_preserve(ct);
+        break;
+      case SIMPLET_STYLE_COLOR:
+        simplet_set_compiled_color(ct, &compiled->color);
+        cairo_fill_preserve(ct);
+        break;
+      case SIMPLET_STYLE_LETTER_SPACING:
+        set_letter_spacing(ct, compiled->letter_spacing);
+        break;
+      default:
+        ;
+    }
+    todo &= ~applyOrder[i];
+  }
+}
+
+// Check if text styles fill glyphs without stroking a halo around them, in
+// which case labels don't need to be turned into paths to be drawn.
+int
+simplet_compiled_styles_fill_only(simplet_compiled_styles_t *compiled){
+  return (compiled->set & SIMPLET_STYLE_COLOR) && compiled->color.valid
+      && !(compiled->set & SIMPLET_STYLE_TEXT_STROKE_COLOR);
+}
+
+// Look up the fields data driven styles read in a query's feature
+// definition. This is done once per query rather than once per feature.
+void
+simplet_bind_compiled_styles(simplet_compiled_styles_t *compiled, OGRFeatureDefnH defn){
+  for(unsigned int i = 0; i < compiled->bindings_length; i++){
+    simplet_style_binding_t *binding = &compiled->bindings[i];
+    binding->field = defn ? OGR_FD_GetFieldIndex(defn, binding->expr->field) : -1;
+  }
+}
+
+// Store a copy of compiled in resolved with data driven styles evaluated for
+// feature. Styles without a value for this feature are left unset.
+void
+simplet_resolve_compiled_styles(simplet_compiled_styles_t *compiled, OGRFeatureH feature,
+  simplet_compiled_styles_t *resolved){
+  *resolved = *compiled;
+  for(unsigned int i = 0; i < compiled->bindings_length; i++){
+    simplet_style_binding_t *binding = &compiled->bindings[i];
+    double value[4];
+    if(!simplet_expr_eval(binding->expr, feature, binding->field, value)) {
+      resolved->set &= ~binding->flag;
+      continue;
+    }
+
+    simplet_color_t *color = NULL;
+    switch(binding->flag){
+      case SIMPLET_STYLE_FILL:
+        color = &resolved->fill;
+        break;
+      case SIMPLET_STYLE_STROKE:
+        color = &resolved->stroke;
+        break;
+      case SIMPLET_STYLE_WEIGHT:
+        resolved->weight = value[0];
+        break;
+      case SIMPLET_STYLE_RADIUS:
+        resolved->radius = value[0];
+        break;
+      default:
+        ;
+    }
+
+    if(color) {
+      color->r = value[0];
+      color->g = value[1];
+      color->b = value[2];
+      color->a = value[3];
+      color->valid = 1;
+    }
+  }
+}
+
+// Test if two colors draw the same.
+static int
+color_equal(simplet_color_t *a, simplet_color_t *b){
+  if(!a->valid || !b->valid)
+    return a->valid == b->valid;
+  return a->r == b->r && a->g == b->g && a->b == b->b && a->a == b->a;
+}
+
+// Test if two resolved copies of the same compiled styles draw the same,
+// only the values data driven styles can change are compared.
+int
+simplet_compiled_styles_equal(simplet_compiled_styles_t *a, simplet_compiled_styles_t *b){
+  return a->set == b->set
+      && color_equal(&a->fill, &b->fill)
+      && color_equal(&a->stroke, &b->stroke)
+      && a->weight == b->weight
+      && a->radius == b->radius;
+}
@@ -10,6 +10,81 @@
 extern "C" {
 #endif
 
+// Bits marking which styles are present in a compiled style set.
+typedef enum {
+  SIMPLET_STYLE_LINE_JOIN          = 1 << 0,
+  SIMPLET_STYLE_LINE_CAP           = 1 << 1,
+  SIMPLET_STYLE_WEIGHT             = 1 << 2,
+  SIMPLET_STYLE_TEXT_STROKE_WEIGHT = 1 << 3,
+  SIMPLET_STYLE_FILL               = 1 << 4,
+  SIMPLET_STYLE_STROKE             = 1 << 5,
+  SIMPLET_STYLE_TEXT_STROKE_COLOR  = 1 << 6,
+  SIMPLET_STYLE_COLOR              = 1 << 7,
+  SIMPLET_STYLE_LETTER_SPACING     = 1 << 8,
+  SIMPLET_STYLE_RADIUS             = 1 << 9,
+  SIMPLET_STYLE_SEAMLESS           = 1 << 10,
+  SIMPLET_STYLE_TEXT_FIELD         = 1 << 11,
+  SIMPLET_STYLE_FONT               = 1 << 12,
+  SIMPLET_STYLE_TEXT_PRIORITY      = 1 << 13,
+  SIMPLET_STYLE_TEXT_LIMIT         = 1 << 14
+} simplet_style_flag_t;
+
+#define SIMPLET_STYLE_POLYGON (SIMPLET_STYLE_LINE_JOIN | SIMPLET_STYLE_LINE_CAP | \
+  SIMPLET_STYLE_WEIGHT | SIMPLET_STYLE_FILL | SIMPLET_STYLE_STROKE)
+#define SIMPLET_STYLE_LINE (SIMPLET_STYLE_LINE_JOIN | SIMPLET_STYLE_LINE_CAP | \
+  SIMPLET_STYLE_WEIGHT | SIMPLET_STYLE_STROKE)
+#define SIMPLET_STYLE_TEXT (SIMPLET_STYLE_TEXT_STROKE_WEIGHT | \
+  SIMPLET_STYLE_TEXT_STROKE_COLOR | SIMPLET_STYLE_COLOR)
+
+// Font used for labels without a font style.
+#define SIMPLET_DEFAULT_FONT "helvetica 12px"
+
+// A color parsed into cairo's channel range, valid is false if the source
+// string couldn't be parsed.
+typedef struct {
+  double r;
+  double g;
+  double b;
+  double a;
+  int valid;
+} simplet_color_t;
+
+// A compiled style whose value is computed per feature by an expression,
+// field is the index of the expression's field in the current query.
+typedef struct {
+  simplet_style_flag_t flag;
+  simplet_expr_t *expr;
+  int field;
+} simplet_style_binding_t;
+
+// Only fill, stroke, weight and radius can be data driven.
+#define SIMPLET_MAX_BINDINGS 4
+
+// A filter's styles parsed once per render, so drawing a feature doesn't
+// have to search the style list or parse strings.
+typedef struct {
+  unsigned int set;
+  simplet_style_binding_t bindings[SIMPLET_MAX_BINDINGS];
+  unsigned int bindings_length;
+  cairo_line_join_t line_join;
+  cairo_line_cap_t line_cap;
+  double weight;
+  double text_stroke_weight;
+  double radius;
+  int letter_spacing;
+  simplet_color_t fill;
+  simplet_color_t stroke;
+  simplet_color_t color;
+  simplet_color_t text_stroke_color;
+  const char *text_field;
+  const char *font;
+  const char *text_priority;  // field ranking labels, larger values go first
+  unsigned int text_limit;    // most labels placed per tile
+  PangoFontDescription *font_description; // owned, only set for text styles
+  double font_pixels;                     // em size of the font, 0 if unknown
+  PangoAttrList *text_attributes;         // owned, only set with letter-spacing
+} simplet_compiled_styles_t;
+
 void
 simplet_style_line_join(void *ct, const char *arg);
 
@@ -31,6 +106,31 @@ simplet_apply_styles(void *ct, simplet_list_t* styles, ...);
 simplet_style_t*
 simplet_lookup_style(simplet_list_t* styles, const char *key);
 
+void
+simplet_compile_styles(simplet_list_t *styles, simplet_compiled_styles_t *compiled);
+
+void
+simplet_release_compiled_styles(simplet_compiled_styles_t *compiled);
+
+void
+simplet_set_compiled_color(cairo_t *ctx, simplet_color_t *color);
+
+void
+simplet_apply_compiled_styles(void *ct, simplet_compiled_styles_t *compiled, unsigned int mask);
+
+int
+simplet_compiled_styles_fill_only(simplet_compiled_styles_t *compiled);
+
+void
+simplet_bind_compiled_styles(simplet_compiled_styles_t *compiled, OGRFeatureDefnH defn);
+
+void
+simplet_resolve_compiled_styles(simplet_compiled_styles_t *compiled, OGRFeatureH feature,
+  simplet_compiled_styles_t *resolved);
+
+int
+simplet_compiled_styles_equal(simplet_compiled_styles_t *a, simplet_compiled_styles_t *b);
+
 void
 simplet_style_get_arg(simplet_style_t* style, char **arg);
 
@@ -1,29 +1,31 @@
 #include "text.h"
+#include "error.h"
 #include "style.h"
 #include "util.h"
 #include "bounds.h"
+#include "shape.h"
+#include "alloc.h"
+#include "probes.h"
 #include <math.h>
 
-// A storage structure that holds the current state of the layout.
-typedef struct {
-  PangoLayout *layout;
-  double x;
-  double y;
-  int placed;
-  simplet_bounds_t *bounds;
-} placement_t;
-
 // Create and return a new lithograph, returns NULL on failure.
 simplet_lithograph_t *
 simplet_lithograph_new(cairo_t *ctx){
   simplet_lithograph_t *litho;
-  if(!(litho = malloc(sizeof(*litho))))
+  if(!(litho = simplet_malloc(sizeof(*litho))))
     return NULL;
 
   memset(litho, 0, sizeof(*litho));
+  litho->error.status = SIMPLET_OK;
 
   if(!(litho->placements = simplet_list_new(litho))){
-    free(litho);
+    simplet_free(litho);
+    return NULL;
+  }
+
+  if(!(litho->collisions = simplet_grid_new(SIMPLET_GRID_CELL_SIZE))){
+    simplet_list_free(litho->placements);
+    simplet_free(litho);
     return NULL;
   }
 
@@ -31,180 +33,352 @@ simplet_lithograph_new(cairo_t *ctx){
   litho->pango_ctx = pango_cairo_create_context(ctx);
   cairo_reference(ctx);
 
+  // Turn font hinting off
+  cairo_font_options_t *opts;
+  if((opts = cairo_font_options_create())){
+    cairo_font_options_set_hint_style(opts, CAIRO_HINT_STYLE_NONE);
+    cairo_font_options_set_hint_metrics(opts, CAIRO_HINT_METRICS_OFF);
+    pango_cairo_context_set_font_options(litho->pango_ctx, opts);
+    cairo_font_options_destroy(opts);
+  }
+
   return litho;
 }
 
+// Add error reporting to simplet_lithograph_t.
+SIMPLET_ERROR_FUNC(lithograph_t)
+
+// Allocate memory for a placement or queued label. With an arena it stays
+// valid until the arena is reset, rather than until it is freed.
+static void *
+litho_alloc(simplet_lithograph_t *litho, size_t size){
+  return litho->arena ? simplet_arena_alloc(litho->arena, size) : simplet_malloc(size);
+}
+
+// Free memory from litho_alloc, arena memory is left for the arena's reset.
+static void
+litho_free(simplet_lithograph_t *litho, void *ptr){
+  if(!litho->arena) simplet_free(ptr);
+}
+
+// Copy a string with litho_alloc.
+static char *
+litho_copy_string(simplet_lithograph_t *litho, const char *str){
+  return litho->arena ? simplet_arena_strdup(litho->arena, str) : simplet_copy_string(str);
+}
+
 // Free a placement.
 void
-placement_vfree(void *placement){
-  placement_t *plc = placement;
+simplet_placement_vfree(void *placement){
+  simplet_placement_t *plc = placement;
   simplet_bounds_free(plc->bounds);
-  g_object_unref(plc->layout);
-  free(plc);
+  simplet_shape_release(plc->shape);
+  simplet_free(plc);
+}
+
+// Release the shape of a placement allocated from an arena.
+static void
+placement_release(void *placement){
+  simplet_placement_t *plc = placement;
+  simplet_shape_release(plc->shape);
 }
 
 // Free a lithograph and unref the stored ctx.
 void
 simplet_lithograph_free(simplet_lithograph_t *litho){
   cairo_destroy(litho->ctx);
-  simplet_list_set_item_free(litho->placements, placement_vfree);
+  if(litho->placements) {
+    simplet_list_set_item_free(litho->placements,
+      litho->arena ? placement_release : simplet_placement_vfree);
+    simplet_list_free(litho->placements);
+  }
   g_object_unref(litho->pango_ctx);
-  simplet_list_free(litho->placements);
-  free(litho);
+  simplet_grid_free(litho->collisions);
+  for(unsigned int i = 0; i < litho->candidates_length; i++)
+    litho_free(litho, litho->candidates[i].text);
+  simplet_free(litho->candidates);
+  simplet_free(litho);
+}
+
+// Set the size of the tile being labeled and how far past its edges labels
+// are still placed. Labels that can't reach this area are skipped before
+// they are shaped.
+void
+simplet_lithograph_set_extent(simplet_lithograph_t *litho, double width, double height, double buffer){
+  litho->width  = width;
+  litho->height = height;
+  litho->buffer = buffer;
 }
 
 // Create and return a new placement.
-placement_t *
-placement_new(PangoLayout *layout, simplet_bounds_t *bounds){
-  placement_t *placement;
-  if(!(placement = malloc(sizeof(*placement))))
+simplet_placement_t *
+placement_new(simplet_lithograph_t *litho, simplet_shape_t *shape, simplet_bounds_t *bounds){
+  simplet_placement_t *placement;
+  if(!(placement = litho_alloc(litho, sizeof(*placement))))
     return NULL;
 
   memset(placement, 0, sizeof(*placement));
 
-  placement->layout = layout;
+  placement->shape  = shape;
   placement->bounds = bounds;
 
   return placement;
 }
 
 // Before placing a new label we need to see if the label overlaps over
-// previously placed labels. This algorithm will be refactored a bit to try
-// NE SE SW NW placements in the future.
-void
-try_and_insert_placement(simplet_lithograph_t *litho, PangoLayout *layout, double x, double y){
-  int width, height;
-  // Find the computed width and height of a layout in image pixels
-  pango_layout_get_pixel_size(layout, &width, &height);
-  simplet_bounds_t *bounds = simplet_bounds_new();
-  if(!bounds) return;
-  // Create a bounds to test for intersection
-  simplet_bounds_extend(bounds, floor(x - width / 2), floor(y - height / 2));
-  simplet_bounds_extend(bounds, floor(x + width / 2), floor(y + height / 2));
-
-  // Iterate through the list of already placed labels and check for overlaps.
-  simplet_listiter_t *iter = simplet_get_list_iter(litho->placements);
-  placement_t *placement;
-  while((placement = (placement_t *) simplet_list_next(iter))){
-    if(simplet_bounds_intersects(placement->bounds, bounds)){
-      simplet_bounds_free(bounds);
-      g_object_unref(layout);
-      simplet_list_iter_free(iter);
-      return;
-    }
+// previously placed labels. Placed labels are indexed in a grid so only
+// labels in nearby cells are checked. This algorithm will be refactored a bit
+// to try NE SE SW NW placements in the future. Returns true if the label was
+// placed, running out of memory rejects the label and sets an error on the
+// lithograph.
+int
+simplet_lithograph_try_placement(simplet_lithograph_t *litho, simplet_shape_t *shape, double x, double y){
+  // The width and height of the shaped label in image pixels
+  int width = shape->width, height = shape->height;
+
+  // Create a bounds on the stack to test for intersection, most candidates
+  // are rejected so only placed labels take memory.
+  simplet_bounds_t candidate;
+  simplet_bounds_init(&candidate);
+  simplet_bounds_extend(&candidate, floor(x - width / 2), floor(y - height / 2));
+  simplet_bounds_extend(&candidate, floor(x + width / 2), floor(y + height / 2));
+
+  // Check for overlaps with already placed labels.
+  if(simplet_grid_intersects(litho->collisions, &candidate)){
+    SIMPLET_PROBE2(label__reject, (int) x, (int) y);
+    litho->rejected++;
+    simplet_shape_release(shape);
+    return 0;
   }
 
   // If we get here we can create and insert a new placement.
-  placement_t *plc = placement_new(layout, bounds);
+  simplet_bounds_t *bounds = litho_alloc(litho, sizeof(*bounds));
+  if(!bounds) {
+    simplet_shape_release(shape);
+    set_error(litho, SIMPLET_OOM, "out of memory placing label");
+    return 0;
+  }
+  *bounds = candidate;
+
+  simplet_placement_t *plc = placement_new(litho, shape, bounds);
   if(!plc) {
-    simplet_bounds_free(bounds);
-    g_object_unref(layout);
-    return;
+    litho_free(litho, bounds);
+    simplet_shape_release(shape);
+    set_error(litho, SIMPLET_OOM, "out of memory placing label");
+    return 0;
+  }
+
+  if(!simplet_list_push(litho->placements, (void *)plc)) {
+    litho_free(litho, bounds);
+    litho_free(litho, plc);
+    simplet_shape_release(shape);
+    set_error(litho, SIMPLET_OOM, "out of memory placing label");
+    return 0;
+  }
+
+  // A label the grid doesn't know about would be drawn under later ones.
+  if(simplet_grid_insert(litho->collisions, bounds) != SIMPLET_OK) {
+    simplet_list_pop(litho->placements);
+    litho_free(litho, bounds);
+    litho_free(litho, plc);
+    simplet_shape_release(shape);
+    set_error(litho, SIMPLET_OOM, "out of memory indexing label");
+    return 0;
   }
 
-  simplet_list_push(litho->placements, (void *)plc);
+  litho->placed++;
+  litho->rejected = 0;
+  if(litho->stats) litho->stats->labels_placed++;
+  SIMPLET_PROBE2(label__accept, (int) x, (int) y);
+  return 1;
 }
 
 
 // Apply the labels to the map.
 void
-simplet_lithograph_apply(simplet_lithograph_t *litho, simplet_list_t *styles){
-  simplet_listiter_t *iter = simplet_get_list_iter(litho->placements);
-  placement_t *placement;
+simplet_lithograph_apply(simplet_lithograph_t *litho, simplet_compiled_styles_t *styles){
+  simplet_lithograph_flush(litho, styles);
+
+  simplet_listiter_t iter;
+  simplet_list_iter_init(litho->placements, &iter);
+  simplet_placement_t *placement;
   cairo_save(litho->ctx);
-  while((placement = (placement_t *) simplet_list_next(iter))){
+
+  // Labels without a halo are drawn straight from cairo's glyph cache rather
+  // than filled as paths.
+  int show = simplet_compiled_styles_fill_only(styles);
+  if(show) simplet_set_compiled_color(litho->ctx, &styles->color);
+
+  while((placement = (simplet_placement_t *) simplet_list_next(&iter))){
     if(placement->placed) continue;
-    cairo_move_to(litho->ctx, placement->bounds->nw.x, placement->bounds->se.y);
     // Draw the placement
-    pango_cairo_layout_path(litho->ctx, placement->layout);
+    if(show)
+      simplet_shape_show(placement->shape, litho->ctx, placement->bounds->nw.x, placement->bounds->se.y);
+    else
+      simplet_shape_path(placement->shape, litho->ctx, placement->bounds->nw.x, placement->bounds->se.y);
     placement->placed = 1;
   }
-  // Apply and draw various outline options.
-  simplet_apply_styles(litho->ctx, styles, "text-stroke-weight", "text-stroke-color", "color",  NULL);
+
+  if(!show) {
+    // Apply and draw various outline options.
+    simplet_apply_compiled_styles(litho->ctx, styles, SIMPLET_STYLE_TEXT);
+    // The styles preserve the path, clear it so the next filter's labels
+    // aren't drawn over these.
+    cairo_new_path(litho->ctx);
+  }
   cairo_restore(litho->ctx);
 }
 
-// Create and add a placement to the current lithograph if it doesn't overlap
-// with current labels.
-void
-simplet_lithograph_add_placement(simplet_lithograph_t *litho,
-  OGRFeatureH feature, simplet_list_t *styles, cairo_t *proj_ctx) {
+// Check if a label of text anchored at x, y in device space falls entirely
+// outside of the lithograph's extent. Every byte of text is assumed to be a
+// glyph an em wide and every line two ems tall, with the halo's stroke
+// around that, which overestimates the size of the label so that no visible
+// label is rejected.
+int
+simplet_lithograph_outside_extent(simplet_lithograph_t *litho, simplet_compiled_styles_t *styles,
+  const char *text, double x, double y){
+  if(!litho->width || !styles->font_pixels) return 0;
+
+  // Find the number of lines and the length of the longest one.
+  size_t lines = 1, longest = 0, length = 0;
+  for(const char *c = text; *c; c++){
+    if(*c == '\n') {
+      lines++;
+      length = 0;
+    } else if(++length > longest) {
+      longest = length;
+    }
+  }
 
-  simplet_style_t *field = simplet_lookup_style(styles, "text-field");
-  if(!field) return;
+  double em = styles->font_pixels;
+  double stroke = styles->set & SIMPLET_STYLE_TEXT_STROKE_WEIGHT ? fabs(styles->text_stroke_weight) : 0;
+  double half_width  = longest * (em + abs(styles->letter_spacing)) / 2 + stroke;
+  double half_height = lines * em + stroke;
+  return x + half_width  < -litho->buffer || x - half_width  > litho->width  + litho->buffer
+      || y + half_height < -litho->buffer || y - half_height > litho->height + litho->buffer;
+}
 
-  OGRFeatureDefnH defn;
-  if(!(defn = OGR_F_GetDefnRef(feature))) return;
+// Check if so many labels in a row have collided that the tile has no room
+// left worth shaping more for.
+int
+simplet_lithograph_is_saturated(simplet_lithograph_t *litho){
+  return litho->saturation && litho->rejected >= litho->saturation;
+}
 
-  int idx = OGR_FD_GetFieldIndex(defn, (const char*) field->arg);
-  if(idx < 0) return;
+// Check if the tile holds as many labels as the text-limit of the filter
+// styles belong to allows, counting the labels of every filter, or is
+// saturated. Filters with a text-priority only fill up when their queue is
+// flushed. A lithograph with an error takes no more labels.
+static int
+over_budget(simplet_lithograph_t *litho, simplet_compiled_styles_t *styles){
+  return litho->error.status != SIMPLET_OK || simplet_lithograph_is_saturated(litho)
+    || ((styles->set & SIMPLET_STYLE_TEXT_LIMIT) && litho->placed >= styles->text_limit);
+}
 
-  // Find the largest sub geometry of a particular multi-geometry.
-  OGRGeometryH super = OGR_F_GetGeometryRef(feature);
-  OGRGeometryH geom = super;
-  double area = 0.0;
-  switch(wkbFlatten(OGR_G_GetGeometryType(super))) {
-    case wkbMultiPolygon:
-    case wkbGeometryCollection:
-      for(int i = 0; i < OGR_G_GetGeometryCount(super); i++) {
-        OGRGeometryH subgeom = OGR_G_GetGeometryRef(super, i);
-        if(subgeom == NULL) continue;
-        double ar = OGR_G_Area(subgeom);
-        if(ar > area) {
-          geom = subgeom;
-          area = ar;
-        }
-      }
-      break;
-    default:
-      ;
-  }
+// Check if the filter styles belong to can't place any more labels on the
+// tile, so its features needn't be anchored or shaped. Filters with a
+// text-priority are never full while labels are being added, their budget is
+// spent when the queue is flushed.
+int
+simplet_lithograph_is_full(simplet_lithograph_t *litho, simplet_compiled_styles_t *styles){
+  if(styles->set & SIMPLET_STYLE_TEXT_PRIORITY)
+    return litho->error.status != SIMPLET_OK || simplet_lithograph_is_saturated(litho);
+  return over_budget(litho, styles);
+}
 
-  // Find the center of our geometry. This sometimes throws an invalid geometry
-  // error, so there is a slight bug here somehow.
-  OGRGeometryH center;
-  if(!(center = OGR_G_CreateGeometry(wkbPoint))) return;
-  if(OGR_G_Centroid(geom, center) == OGRERR_FAILURE) {
-    OGR_G_DestroyGeometry(center);
-    return;
+// Queue a copy of text to be placed in priority order, drops the label when
+// out of memory.
+static void
+queue_candidate(simplet_lithograph_t *litho, const char *text, double x, double y, double priority){
+  if(litho->candidates_length == litho->candidates_size) {
+    unsigned int size = litho->candidates_size ? litho->candidates_size * 2 : 64;
+    simplet_candidate_t *candidates;
+    if(!(candidates = simplet_realloc(litho->candidates, size * sizeof(*candidates))))
+      return;
+    litho->candidates      = candidates;
+    litho->candidates_size = size;
   }
 
-  // Turn font hinting off
-  cairo_font_options_t *opts;
-  if(!(opts = cairo_font_options_create())){
-    OGR_G_DestroyGeometry(center);
+  simplet_candidate_t *candidate = &litho->candidates[litho->candidates_length];
+  if(!(candidate->text = litho_copy_string(litho, text)))
     return;
+  candidate->x        = x;
+  candidate->y        = y;
+  candidate->priority = priority;
+  candidate->order    = litho->candidates_length++;
+}
+
+// Order candidates by descending priority, ties keep the order OGR returned
+// the features in.
+static int
+compare_candidates(const void *a, const void *b){
+  const simplet_candidate_t *ca = a, *cb = b;
+  if(ca->priority != cb->priority)
+    return ca->priority > cb->priority ? -1 : 1;
+  return ca->order < cb->order ? -1 : ca->order > cb->order;
+}
+
+// Place the labels queued for the filter styles belong to, highest priority
+// first, and stop shaping them once the tile reaches its text-limit or is
+// saturated. It must be called once the filter's features have all been
+// added.
+void
+simplet_lithograph_flush(simplet_lithograph_t *litho, simplet_compiled_styles_t *styles){
+  qsort(litho->candidates, litho->candidates_length, sizeof(*litho->candidates), compare_candidates);
+
+  for(unsigned int i = 0; i < litho->candidates_length; i++){
+    simplet_candidate_t *candidate = &litho->candidates[i];
+    simplet_shape_t *shape;
+    if(!over_budget(litho, styles)
+      && (shape = simplet_shape_get(litho->pango_ctx, candidate->text, styles))) {
+      if(litho->stats) litho->stats->labels_shaped++;
+      simplet_lithograph_try_placement(litho, shape, candidate->x, candidate->y);
+    }
+    litho_free(litho, candidate->text);
   }
-  cairo_font_options_set_hint_style(opts, CAIRO_HINT_STYLE_NONE);
-  cairo_font_options_set_hint_metrics(opts, CAIRO_HINT_METRICS_OFF);
-  pango_cairo_context_set_font_options(litho->pango_ctx, opts);
-  cairo_font_options_destroy(opts);
 
-  // Get the field containing the text for the label.
-  char *txt = simplet_copy_string(OGR_F_GetFieldAsString(feature, idx));
-  PangoLayout *layout = pango_layout_new(litho->pango_ctx);
-  pango_layout_set_text(layout, txt, -1);
-  free(txt);
+  litho->candidates_length = 0;
+}
 
-  // Grab the font to use and apply tracking.
-  simplet_style_t *font = simplet_lookup_style(styles, "font");
-  simplet_apply_styles(layout, styles, "letter-spacing", NULL);
+// Create and add a placement for a feature anchored at x, y in the user space
+// of proj_ctx to the current lithograph if it doesn't overlap with current
+// labels. Labels of filters with a text-priority are queued until the
+// lithograph is flushed.
+void
+simplet_lithograph_add_placement(simplet_lithograph_t *litho, OGRFeatureH feature,
+  simplet_compiled_styles_t *styles, cairo_t *proj_ctx, double x, double y) {
 
-  const char *font_family;
+  if(!(styles->set & SIMPLET_STYLE_TEXT_FIELD)) return;
+  if(simplet_lithograph_is_full(litho, styles)) return;
 
-  if(!font)
-    font_family = "helvetica 12px";
-  else
-    font_family = font->arg;
+  OGRFeatureDefnH defn;
+  if(!(defn = OGR_F_GetDefnRef(feature))) return;
 
-  PangoFontDescription *desc = pango_font_description_from_string(font_family);
-  pango_layout_set_font_description(layout, desc);
-  pango_font_description_free(desc);
+  int idx = OGR_FD_GetFieldIndex(defn, styles->text_field);
+  if(idx < 0) return;
 
-  double x = OGR_G_GetX(center, 0), y = OGR_G_GetY(center, 0);
+  // Move the anchor into device space.
   cairo_user_to_device(proj_ctx, &x, &y);
 
+  // Skip labels that can't be seen before doing any work with Pango.
+  const char *text = OGR_F_GetFieldAsString(feature, idx);
+  if(simplet_lithograph_outside_extent(litho, styles, text, x, y)) return;
+
+  if(styles->set & SIMPLET_STYLE_TEXT_PRIORITY) {
+    // Features without a priority are labeled last.
+    int field = OGR_FD_GetFieldIndex(defn, styles->text_priority);
+    double priority = field >= 0 && OGR_F_IsFieldSet(feature, field) ?
+      OGR_F_GetFieldAsDouble(feature, field) : -HUGE_VAL;
+    queue_candidate(litho, text, x, y, priority);
+    return;
+  }
+
+  // Shape the text for the label, or reuse it if this label has been shaped
+  // before.
+  simplet_shape_t *shape;
+  if(!(shape = simplet_shape_get(litho->pango_ctx, text, styles))) return;
+  if(litho->stats) litho->stats->labels_shaped++;
+
   // Finally try the placement and test for overlaps.
-  try_and_insert_placement(litho, layout, x, y);
-  OGR_G_DestroyGeometry(center);
+  simplet_lithograph_try_placement(litho, shape, x, y);
 }
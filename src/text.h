@@ -3,15 +3,54 @@
 
 #include "types.h"
 #include "list.h"
+#include "style.h"
+#include "grid.h"
+#include "shape.h"
+#include "arena.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// A tile is saturated, and stops shaping labels, once this many labels in a
+// row have collided with the ones already placed.
+#define SIMPLET_LABEL_SATURATION 256
+
+// A label that has been placed.
+typedef struct {
+  simplet_shape_t *shape;
+  double x;
+  double y;
+  int placed;
+  simplet_bounds_t *bounds;
+} simplet_placement_t;
+
+// A label waiting to be placed in priority order, anchored in device space.
+typedef struct {
+  char *text;
+  double x;
+  double y;
+  double priority;
+  unsigned int order;
+} simplet_candidate_t;
+
 typedef struct {
+  SIMPLET_ERROR_FIELDS
   cairo_t *ctx;
   PangoContext *pango_ctx;
   simplet_list_t *placements;
+  simplet_grid_t *collisions;
+  double width;  // size of the tile in pixels, 0 if labels aren't culled
+  double height;
+  double buffer;
+  simplet_candidate_t *candidates; // labels queued by a filter with text-priority
+  unsigned int candidates_length;
+  unsigned int candidates_size;
+  unsigned int placed;             // labels placed on the tile
+  unsigned int rejected;           // labels in a row that collided
+  unsigned int saturation;         // rejected labels that saturate the tile, 0 never
+  simplet_arena_t *arena;          // where placements come from, NULL for malloc
+  simplet_stats_t *stats;          // counts labels shaped and placed, may be NULL
 } simplet_lithograph_t;
 
 
@@ -21,12 +60,34 @@ simplet_lithograph_new(cairo_t *ctx);
 void
 simplet_lithograph_free(simplet_lithograph_t *litho);
 
+void
+simplet_placement_vfree(void *placement);
+
+void
+simplet_lithograph_set_extent(simplet_lithograph_t *litho, double width, double height, double buffer);
+
 void
 simplet_lithograph_add_placement(simplet_lithograph_t *litho, OGRFeatureH feature,
-  simplet_list_t *styles, cairo_t *proj_ctx);
+  simplet_compiled_styles_t *styles, cairo_t *proj_ctx, double x, double y);
+
+int
+simplet_lithograph_outside_extent(simplet_lithograph_t *litho, simplet_compiled_styles_t *styles,
+  const char *text, double x, double y);
+
+int
+simplet_lithograph_is_saturated(simplet_lithograph_t *litho);
+
+int
+simplet_lithograph_is_full(simplet_lithograph_t *litho, simplet_compiled_styles_t *styles);
 
 void
-simplet_lithograph_apply(simplet_lithograph_t *litho, simplet_list_t *styles);
+simplet_lithograph_flush(simplet_lithograph_t *litho, simplet_compiled_styles_t *styles);
+
+void
+simplet_lithograph_apply(simplet_lithograph_t *litho, simplet_compiled_styles_t *styles);
+
+int
+simplet_lithograph_try_placement(simplet_lithograph_t *litho, simplet_shape_t *shape, double x, double y);
 
 #ifdef __cplusplus
 }
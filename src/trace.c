@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "trace.h"
+#include "map.h"
+#include "util.h"
+#include "alloc.h"
+
+// Events from every thread are appended to one buffer under a lock. Nothing
+// is recorded, and no lock is taken, unless a trace has been started.
+static struct {
+  int enabled;
+  double epoch;
+  simplet_trace_event_t *events;
+  unsigned int length;
+  unsigned int size;
+  unsigned int threads;
+  pthread_mutex_t lock;
+} trace = { 0, 0, NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+
+static void
+make_key(){
+  pthread_key_create(&thread_key, NULL);
+}
+
+// A small number naming the calling thread in the trace, assigned the first
+// time the thread records an event. Must be called with the lock held.
+static unsigned int
+thread_id(){
+  pthread_once(&key_once, make_key);
+  uintptr_t id = (uintptr_t) pthread_getspecific(thread_key);
+  if(!id) {
+    id = ++trace.threads;
+    pthread_setspecific(thread_key, (void *) id);
+  }
+  return (unsigned int) id;
+}
+
+// Free the recorded events.
+static void
+clear(){
+  for(unsigned int i = 0; i < trace.length; i++)
+    simplet_free(trace.events[i].detail);
+  simplet_free(trace.events);
+  trace.events = NULL;
+  trace.length = trace.size = 0;
+}
+
+// Start recording render phases, dropping any earlier events. Starting and
+// stopping a trace must not race with renders.
+void
+simplet_trace_start(){
+  pthread_mutex_lock(&trace.lock);
+  clear();
+  trace.epoch   = simplet_time_now();
+  trace.enabled = 1;
+  pthread_mutex_unlock(&trace.lock);
+}
+
+// Check if a trace is being recorded.
+int
+simplet_trace_enabled(){
+  return trace.enabled;
+}
+
+// Return when a phase starts, or 0 when nothing is being recorded.
+double
+simplet_trace_begin(){
+  return trace.enabled ? simplet_time_now() : 0;
+}
+
+// Work out which slippy tile render is drawing from its bounds.
+static void
+tile_of(simplet_render_t *render, simplet_trace_event_t *event){
+  event->x = event->y = event->z = -1;
+  if(!render || render->zoom < 0) return;
+
+  double length = SIMPLET_MERC_LENGTH / pow(2.0, render->zoom);
+  double origin = SIMPLET_MERC_LENGTH / 2;
+  event->x = (int) floor((render->bounds.nw.x + origin) / length + 0.5);
+  event->y = (int) floor((origin - render->bounds.nw.y) / length + 0.5);
+  event->z = render->zoom;
+}
+
+// Record a phase of render named name that began at start, as returned by
+// simplet_trace_begin. category and name must be string constants, detail is
+// copied.
+void
+simplet_trace_end(simplet_render_t *render, const char *category, const char *name,
+  const char *detail, double start){
+  if(!trace.enabled || !start) return;
+  double end = simplet_time_now();
+
+  simplet_trace_event_t event;
+  event.category = category;
+  event.name     = name;
+  event.detail   = detail ? simplet_copy_string(detail) : NULL;
+  event.start    = (start - trace.epoch) * 1e6;
+  event.duration = (end - start) * 1e6;
+  tile_of(render, &event);
+
+  pthread_mutex_lock(&trace.lock);
+  event.thread = thread_id();
+  if(trace.length == trace.size && trace.size < SIMPLET_TRACE_MAX_EVENTS) {
+    unsigned int size = trace.size ? trace.size * 2 : 1024;
+    simplet_trace_event_t *events;
+    if((events = simplet_realloc(trace.events, size * sizeof(*events)))) {
+      trace.events = events;
+      trace.size   = size;
+    }
+  }
+
+  if(trace.length < trace.size)
+    trace.events[trace.length++] = event;
+  else
+    simplet_free(event.detail);
+  pthread_mutex_unlock(&trace.lock);
+}
+
+// Write str as a JSON string.
+static void
+write_string(FILE *file, const char *str){
+  fputc('"', file);
+  for(; *str; str++){
+    unsigned char c = *str;
+    if(c == '"' || c == '\\')
+      fprintf(file, "\\%c", c);
+    else if(c < 0x20)
+      fprintf(file, "\\u%04x", c);
+    else
+      fputc(c, file);
+  }
+  fputc('"', file);
+}
+
+// Stop recording and write the trace to path in Chrome's trace event format,
+// which chrome://tracing and Perfetto can open. Each phase is a complete
+// event on the timeline of the thread that ran it, with the tile and any
+// detail in its args.
+simplet_status_t
+simplet_trace_stop(const char *path){
+  pthread_mutex_lock(&trace.lock);
+  trace.enabled = 0;
+
+  FILE *file;
+  if(!(file = fopen(path, "w"))) {
+    clear();
+    pthread_mutex_unlock(&trace.lock);
+    return SIMPLET_ERR;
+  }
+
+  fputs("{\"traceEvents\":[", file);
+  for(unsigned int i = 0; i < trace.length; i++){
+    simplet_trace_event_t *event = &trace.events[i];
+    fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+      "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"x\":%d,\"y\":%d,\"z\":%d",
+      i ? "," : "", event->name, event->category, event->thread,
+      event->start, event->duration, event->x, event->y, event->z);
+    if(event->detail) {
+      fputs(",\"detail\":", file);
+      write_string(file, event->detail);
+    }
+    fputs("}}", file);
+  }
+  fputs("\n]}\n", file);
+
+  int failed = ferror(file);
+  failed = fclose(file) || failed;
+  clear();
+  pthread_mutex_unlock(&trace.lock);
+  return failed ? SIMPLET_ERR : SIMPLET_OK;
+}
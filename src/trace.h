@@ -0,0 +1,46 @@
+#ifndef _SIMPLE_TILES_TRACE_H
+#define _SIMPLE_TILES_TRACE_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most events kept by a trace, later events are dropped.
+#define SIMPLET_TRACE_MAX_EVENTS (1 << 20)
+
+// A span of time spent in one phase of a render.
+typedef struct {
+  const char *category;
+  const char *name;
+  char *detail;        // owned, a layer source or query, may be NULL
+  double start;        // microseconds since the trace started
+  double duration;
+  unsigned int thread;
+  int x;               // tile the render is for, -1 when unknown
+  int y;
+  int z;
+} simplet_trace_event_t;
+
+void
+simplet_trace_start();
+
+simplet_status_t
+simplet_trace_stop(const char *path);
+
+int
+simplet_trace_enabled();
+
+double
+simplet_trace_begin();
+
+void
+simplet_trace_end(simplet_render_t *render, const char *category, const char *name,
+  const char *detail, double start);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
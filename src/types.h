@@ -29,23 +29,34 @@ typedef void (*simplet_user_data_free)(void *val);
 #define SIMPLET_FREEFUNC \
   simplet_user_data_free free;
 
-/* lists, nodes, and iterators */
+#if defined(__GNUC__)
+#define SIMPLET_DEPRECATED __attribute__((deprecated))
+#else
+#define SIMPLET_DEPRECATED
+#endif
+
+/* lists and iterators */
+
+// Lists used to be linked through these nodes, they now keep their items in
+// an array and never use them. Kept so code that names the type still
+// compiles, and will be removed.
 typedef struct simplet_node_t {
   struct simplet_node_t *next;
   struct simplet_node_t *prev;
   SIMPLET_USER_DATA
-} simplet_node_t;
-
+} simplet_node_t SIMPLET_DEPRECATED;
 
 typedef struct simplet_list_t {
-  simplet_node_t *head;
-  simplet_node_t *tail;
+  void **items;
+  unsigned int size;
   SIMPLET_FREEFUNC
   unsigned int length;
 } simplet_list_t;
 
 typedef struct simplet_listiter_t {
-  simplet_node_t *next;
+  simplet_list_t *list;
+  unsigned int next;
+  int heap;
 } simplet_listiter_t;
 
 /* errors */
@@ -76,23 +87,52 @@ typedef struct {
   SIMPLET_USER_DATA
 } simplet_with_user_data_t;
 
+// Where the time of a render went, in seconds, and how much work it did.
+typedef struct {
+  double open_time;      // opening layer datasources
+  double query_time;     // executing SQL and reading features
+  double transform_time; // reprojecting geometries
+  double plot_time;      // building and drawing paths
+  double label_time;     // anchoring, shaping, placing and drawing labels
+  double composite_time; // painting each filter onto the tile
+  double encode_time;    // writing the png
+  double total_time;
+  unsigned long features_read;
+  unsigned long features_skipped;  // no geometry, or it couldn't be reprojected
+  unsigned long vertices_read;     // vertices before simplification
+  unsigned long vertices_emitted;  // points added to paths
+  unsigned long labels_shaped;
+  unsigned long labels_placed;
+  unsigned long queries;           // filter queries run against datasources
+  unsigned long bytes_encoded;     // size of the png
+} simplet_stats_t;
+
 typedef struct {
   SIMPLET_ERROR_FIELDS
   SIMPLET_USER_DATA
   simplet_bounds_t     *bounds;
   simplet_list_t       *layers;
   OGRSpatialReferenceH proj;
+  int mercator;  // if proj is SIMPLET_MERCATOR, which slippy tiles need
   double buffer; // pixel coords
   unsigned int width;
   unsigned int height;
+  int zoom; // -1 when the map isn't at a known zoom level
   char *bgcolor;
+  simplet_list_t       *labels; // labels placed ahead of time, one per zoom
+  simplet_stats_t      stats;   // from the last render of the map
+  struct simplet_arena_t *arena; // kept between the map's renders
 } simplet_map_t;
 
 typedef struct {
   SIMPLET_ERROR_FIELDS
   SIMPLET_USER_DATA
   char           *source;
+  char           *name;        // reported by metrics and traces, NULL for the source
+  char           *source_name; // the source without any password in it
   simplet_list_t *filters;
+  unsigned int   min_zoom;
+  unsigned int   max_zoom;
 } simplet_layer_t;
 
 typedef struct {
@@ -100,13 +140,69 @@ typedef struct {
   SIMPLET_USER_DATA
   char *ogrsql;
   simplet_list_t *styles;
+  unsigned int min_zoom;
+  unsigned int max_zoom;
 } simplet_filter_t;
 
+/* per render state */
+
+// The time a render spent on one layer and the queries it ran there, held
+// until the render is added to the process wide metrics.
+typedef struct {
+  const char *name;
+  double seconds;
+  unsigned long queries;
+} simplet_layer_stats_t;
+
+// Everything a single render reads or writes that isn't configuration. The
+// map, its layers, filters and styles act as a template: rendering only reads
+// them, so one map can be shared by concurrent renders that each have their
+// own simplet_render_t.
+typedef struct {
+  SIMPLET_ERROR_FIELDS
+  simplet_map_t        *map;
+  simplet_bounds_t     bounds;
+  OGRSpatialReferenceH proj;
+  unsigned int width;
+  unsigned int height;
+  int zoom;
+  struct simplet_labels_t *labels; // labels placed ahead of time, if any
+  struct simplet_arena_t  *arena;  // objects that only live for one render
+  simplet_stats_t stats;
+  simplet_layer_stats_t *layer_stats; // one per layer drawn by the last render
+  unsigned int layer_stats_length;
+  unsigned int layer_stats_size;
+} simplet_render_t;
+
+/* data driven style values */
+typedef enum {
+  SIMPLET_EXPR_MATCH,       // categorical, match(FIELD, a:#ff0000, b:#00ff00, #cccccc)
+  SIMPLET_EXPR_STEP,        // graduated, step(FIELD, #cccccc, 10:#ff0000, 100:#00ff00)
+  SIMPLET_EXPR_INTERPOLATE  // linear ramp, interpolate(FIELD, 0:1, 100:4)
+} simplet_expr_type_t;
+
+typedef struct {
+  char   *key;     // match value, NULL for other expressions
+  double input;    // lower bound for step and interpolate stops, or a numeric match key
+  int    numeric;  // the match key is a number, compared by value with numeric fields
+  double value[4]; // a number in value[0], or a color as r, g, b, a
+} simplet_expr_stop_t;
+
+typedef struct {
+  simplet_expr_type_t type;
+  char *field;
+  simplet_expr_stop_t *stops;
+  unsigned int length;
+  int has_fallback;
+  double fallback[4];
+} simplet_expr_t;
+
 typedef struct {
   SIMPLET_ERROR_FIELDS
   SIMPLET_USER_DATA
   char *key;
   char *arg;
+  simplet_expr_t *expr;
 } simplet_style_t;
 
 
@@ -116,6 +212,9 @@ typedef struct {
 #define SIMPLET_PI M_PI
 #endif
 
+// Layers and filters are visible at every zoom level up to this by default.
+#define SIMPLET_MAX_ZOOM 32
+
 #define SIMPLET_MERCATOR "epsg:3785"
 #define SIMPLET_WGS84    "epsg:4326"
 
@@ -3,12 +3,25 @@
 #include <stdio.h>
 
 #include "util.h"
+#include "alloc.h"
 
 // A safe copy string.
 char*
 simplet_copy_string(const char *src){
   if(src == NULL) src = "";
-  return strdup(src);
+  size_t length = strlen(src) + 1;
+  char *copy;
+  if(!(copy = simplet_malloc(length)))
+    return NULL;
+  return memcpy(copy, src, length);
+}
+
+// Seconds on a monotonic clock, for measuring how long things take.
+double
+simplet_time_now(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
 // Parse a color in hex form.
@@ -12,6 +12,9 @@ int
 simplet_parse_color(const char *src, unsigned int *r, unsigned int *g,
                     unsigned int *b, unsigned int *a);
 
+double
+simplet_time_now();
+
 #define SIMPLET_CCEIL 256.0
 
 #ifdef __cplusplus
@@ -1,12 +1,21 @@
+#define _XOPEN_SOURCE 700
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <assert.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/resource.h>
 #include <simple-tiles/simple_tiles.h>
 #include <simple-tiles/list.h>
 #include <simple-tiles/filter.h>
 #include <simple-tiles/layer.h>
 #include <simple-tiles/error.h>
+#include <simple-tiles/style.h>
+#include <simple-tiles/bounds.h>
+#include <simple-tiles/text.h>
+#include <simple-tiles/util.h>
 
 static void*
 setup_map(){
@@ -121,6 +130,23 @@ bench_text(void *ctx){
   assert(SIMPLET_OK == simplet_map_get_status(map));
 }
 
+static void
+bench_dense_text(void *ctx){
+  simplet_map_t *map = ctx;
+  simplet_map_set_slippy(map, 0, 0, 0);
+  simplet_map_set_size(map, 1024, 1024);
+  simplet_layer_t  *layer  = simplet_map_add_layer(map,
+      "../data/ne_10m_populated_places.shp");
+  simplet_filter_t *filter = simplet_layer_add_filter(layer,
+      "SELECT * from 'ne_10m_populated_places'");
+  simplet_filter_add_style(filter, "text-field", "NAME");
+  simplet_filter_add_style(filter, "font", "Futura Medium 6");
+  simplet_filter_add_style(filter, "color", "#226688");
+  char *data = NULL;
+  simplet_map_render_to_stream(map, data, stream);
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+}
+
 static void
 bench_unprojected(void *ctx){
   simplet_map_t *map = ctx;
@@ -142,28 +168,296 @@ bench_list(void *ctx){
   simplet_list_free(ctx);
 }
 
+// Micro-benchmarks of the hot paths inside a render. Each repeats its call
+// enough times to be measurable on its own.
+
+// Results are summed here so calls can't be optimized away.
+static volatile long sink;
+
+// The styles of a typical labeled polygon filter.
+static const char *style_keys[][2] = {
+  { "fill",               "#061F37ff" },
+  { "stroke",             "#ffffffff" },
+  { "weight",             "0.5" },
+  { "line-join",          "round" },
+  { "line-cap",           "square" },
+  { "radius",             "2" },
+  { "text-field",         "NAME" },
+  { "font",               "Sans 8" },
+  { "color",              "#226688ff" },
+  { "text-stroke-color",  "#ffffff88" },
+  { "text-stroke-weight", "1" },
+  { "letter-spacing",     "1" },
+  { NULL, NULL }
+};
+
+typedef struct {
+  cairo_surface_t *surface;
+  cairo_t *ctx;
+  simplet_list_t *styles;
+} styles_t;
+
+static void*
+setup_styles(){
+  styles_t *styles;
+  assert((styles = malloc(sizeof(*styles))));
+  styles->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 256, 256);
+  styles->ctx     = cairo_create(styles->surface);
+  assert((styles->styles = simplet_list_new()));
+  simplet_list_set_item_free(styles->styles, simplet_style_vfree);
+  for(int i = 0; style_keys[i][0]; i++)
+    assert(simplet_list_push(styles->styles, simplet_style_new(style_keys[i][0], style_keys[i][1])));
+  return styles;
+}
+
+static void
+teardown_styles(void *ctx){
+  styles_t *styles = ctx;
+  simplet_list_free(styles->styles);
+  cairo_destroy(styles->ctx);
+  cairo_surface_destroy(styles->surface);
+  free(styles);
+}
+
+#define LOOKUPS 100000
+static void
+bench_lookup_style(void *ctx){
+  styles_t *styles = ctx;
+  for(int i = 0; i < LOOKUPS; i++){
+    sink += simplet_lookup_style(styles->styles, style_keys[i % 12][0]) != NULL;
+    sink += simplet_lookup_style(styles->styles, "seamless") != NULL;
+  }
+}
+
+#define APPLIES 10000
+static void
+bench_apply_styles(void *ctx){
+  styles_t *styles = ctx;
+  for(int i = 0; i < APPLIES; i++)
+    simplet_apply_styles(styles->ctx, styles->styles,
+      "line-join", "line-cap", "weight", "fill", "stroke", NULL);
+}
+
+#define BOUNDS 1024
+typedef struct {
+  simplet_bounds_t bounds[BOUNDS];
+  OGRSpatialReferenceH proj;
+} bounds_t;
+
+// Boxes of many sizes scattered across the mercator plane.
+static void*
+setup_bounds(){
+  bounds_t *bounds;
+  assert((bounds = malloc(sizeof(*bounds))));
+  unsigned int state = 1;
+  for(int i = 0; i < BOUNDS; i++){
+    double x[2], y[2];
+    for(int j = 0; j < 2; j++){
+      state = state * 1103515245 + 12345;
+      x[j] = (state % 40000) * 1000.0 - 2e7;
+      state = state * 1103515245 + 12345;
+      y[j] = (state % 40000) * 1000.0 - 2e7;
+    }
+    simplet_bounds_init(&bounds->bounds[i]);
+    simplet_bounds_extend(&bounds->bounds[i], x[0], y[0]);
+    simplet_bounds_extend(&bounds->bounds[i], x[0] + fabs(x[1]) / 100, y[0] + fabs(y[1]) / 100);
+  }
+  assert((bounds->proj = OSRNewSpatialReference(NULL)));
+  assert(OSRSetFromUserInput(bounds->proj, SIMPLET_MERCATOR) == OGRERR_NONE);
+  return bounds;
+}
+
+static void
+teardown_bounds(void *ctx){
+  bounds_t *bounds = ctx;
+  OSRRelease(bounds->proj);
+  free(bounds);
+}
+
+#define INTERSECTIONS 1000
+static void
+bench_bounds_intersects(void *ctx){
+  bounds_t *bounds = ctx;
+  for(int i = 0; i < INTERSECTIONS; i++)
+    for(int j = 0; j < BOUNDS; j++)
+      sink += simplet_bounds_intersects(&bounds->bounds[j], &bounds->bounds[(j * 7 + i) % BOUNDS]);
+}
+
+#define CONVERSIONS 10000
+static void
+bench_bounds_to_ogr(void *ctx){
+  bounds_t *bounds = ctx;
+  for(int i = 0; i < CONVERSIONS; i++){
+    OGRGeometryH geom;
+    assert((geom = simplet_bounds_to_ogr(&bounds->bounds[i % BOUNDS], bounds->proj)));
+    OGR_G_DestroyGeometry(geom);
+  }
+}
+
+#define PLACEMENTS 500
+typedef struct {
+  styles_t *styles;
+  simplet_compiled_styles_t compiled;
+  simplet_lithograph_t *litho;
+  simplet_shape_t *shapes[PLACEMENTS];
+} placements_t;
+
+// A lithograph for a large tile and hundreds of shaped labels, enough that
+// many of them collide.
+static void*
+setup_placements(){
+  placements_t *placements;
+  assert((placements = malloc(sizeof(*placements))));
+  placements->styles = setup_styles();
+  simplet_compile_styles(placements->styles->styles, &placements->compiled);
+  assert((placements->litho = simplet_lithograph_new(placements->styles->ctx)));
+  simplet_lithograph_set_extent(placements->litho, 1024, 1024, 0);
+
+  char label[32];
+  for(int i = 0; i < PLACEMENTS; i++){
+    snprintf(label, sizeof(label), "Place %i", i);
+    assert((placements->shapes[i] = simplet_shape_get(placements->litho->pango_ctx,
+      label, &placements->compiled)));
+  }
+  return placements;
+}
+
+static void
+teardown_placements(void *ctx){
+  placements_t *placements = ctx;
+  simplet_lithograph_free(placements->litho);
+  simplet_release_compiled_styles(&placements->compiled);
+  teardown_styles(placements->styles);
+  free(placements);
+}
+
+static void
+bench_placement(void *ctx){
+  placements_t *placements = ctx;
+  for(int i = 0; i < PLACEMENTS; i++)
+    sink += simplet_lithograph_try_placement(placements->litho, placements->shapes[i],
+      (i * 37) % 1024, (i * 91) % 1024);
+}
+
+// plot_part is internal to filter.c, so long rings are measured by drawing a
+// single million vertex polygon from data/synthetic_large_polygon.shp.
+static void
+bench_long_ring(void *ctx){
+  simplet_map_t *map = ctx;
+  simplet_map_set_size(map, 256, 256);
+  simplet_map_set_srs(map, SIMPLET_WGS84);
+  simplet_map_set_bounds(map, -15, -15, 15, 15);
+  simplet_layer_t  *layer  = simplet_map_add_layer(map,
+      "../data/synthetic_large_polygon.shp");
+  simplet_filter_t *filter = simplet_layer_add_filter(layer,
+      "SELECT * from 'synthetic_large_polygon'");
+  simplet_filter_add_style(filter, "weight", "0.5");
+  simplet_filter_add_style(filter, "fill",   "#061F37ff");
+  simplet_filter_add_style(filter, "stroke", "#ffffffff");
+  char *data = NULL;
+  simplet_map_render_to_stream(map, data, stream);
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+}
+
+#define COLORS 100000
+static void
+bench_parse_color(void *ctx){
+  static const char *colors[] = { "#061F37ff", "#ffffff", "#22668888", "#d3e46f" };
+  unsigned int r, g, b, a;
+  for(int i = 0; i < COLORS; i++)
+    sink += simplet_parse_color(colors[i % 4], &r, &g, &b, &a);
+  (void) ctx;
+}
+
+static void*
+setup_none(){
+  return NULL;
+}
+
+static void
+teardown_none(void *ctx){
+  (void) ctx;
+}
+
 typedef struct {
   const char *name;
   void *(*setup)();
   void (*call)(void *ctx);
   void (*teardown)(void *ctx);
-  const int times;
 } bench_wrap_t;
 
 #define BENCH(around, name) \
-  { #name, &setup_##around, &bench_##name, &teardown_##around, 10 },
+  { #name, &setup_##around, &bench_##name, &teardown_##around },
 
 bench_wrap_t benchmarks[] = {
   BENCH(map, render)
   BENCH(map, unprojected)
   BENCH(map, text)
+  BENCH(map, dense_text)
   BENCH(map, seamless)
   BENCH(map, empty)
   BENCH(map, many_filters)
   BENCH(list, list)
-  { NULL, NULL, NULL, NULL, 0}
+  BENCH(styles, lookup_style)
+  BENCH(styles, apply_styles)
+  BENCH(bounds, bounds_intersects)
+  BENCH(bounds, bounds_to_ogr)
+  BENCH(placements, placement)
+  BENCH(map, long_ring)
+  BENCH(none, parse_color)
+  { NULL, NULL, NULL, NULL }
 };
 
+// How to run the benchmarks and report on them, set from the command line.
+typedef enum {
+  FORMAT_TEXT,
+  FORMAT_JSON,
+  FORMAT_CSV
+} format_t;
+
+typedef struct {
+  int iterations;
+  int warmup;
+  const char *filter;
+  format_t format;
+} options_t;
+
+// Timings of one benchmark in seconds.
+typedef struct {
+  const char *name;
+  int runs;
+  double wall_total;
+  double cpu_total;
+  double mean;
+  double stdev;
+  double p50;
+  double p95;
+  double p99;
+  double tiles_per_sec;
+  long peak_rss_kb;
+} result_t;
+
+static double
+seconds(clockid_t clock){
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+compare_doubles(const void *a, const void *b){
+  double da = *(const double *) a, db = *(const double *) b;
+  return (da > db) - (da < db);
+}
+
+// The nearest rank percentile of sorted, which holds count values.
+static double
+percentile(double *sorted, int count, double pct){
+  int rank = (int) ceil(pct / 100 * count);
+  if(rank < 1) rank = 1;
+  return sorted[rank - 1];
+}
+
 static double
 sum(double *arr, int count){
   double sum = 0;
@@ -179,6 +473,7 @@ mean(double *arr, int count){
 
 static double
 stdev(double *arr, int count){
+  if(count < 2) return 0;
   double avg = mean(arr, count);
   double var = 0;
   for(int i = 0; i < count; i++)
@@ -186,25 +481,171 @@ stdev(double *arr, int count){
   return sqrt(var / (count - 1));
 }
 
-int
-main(){
-  bench_wrap_t *bench = (bench_wrap_t*)&benchmarks;
-  for(bench = (bench_wrap_t*)&benchmarks; bench->call; bench++){
-    printf("\nbench %s:\n", bench->name);
-    double runs[bench->times];
-    for(int i = 0; i < bench->times; i++){
-      void *data = bench->setup();
-      clock_t start = clock();
-      bench->call(data);
-      runs[i] = (double) (clock() - start) / CLOCKS_PER_SEC;
+// The most memory the process has held so far, in kilobytes.
+static long
+peak_rss_kb(){
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage)) return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+// Run a benchmark's warmup and timed iterations. Setup and teardown aren't
+// timed.
+static void
+run(bench_wrap_t *bench, options_t *opts, result_t *result){
+  int text = opts->format == FORMAT_TEXT;
+  double wall[opts->iterations];
+  double cpu = 0;
+
+  if(text) printf("\nbench %s:\n", bench->name);
+  for(int i = -opts->warmup; i < opts->iterations; i++){
+    void *data = bench->setup();
+    double wall_start = seconds(CLOCK_MONOTONIC);
+    double cpu_start  = seconds(CLOCK_PROCESS_CPUTIME_ID);
+    bench->call(data);
+    double wall_end = seconds(CLOCK_MONOTONIC);
+    double cpu_end  = seconds(CLOCK_PROCESS_CPUTIME_ID);
+    bench->teardown(data);
+
+    // Warmup runs fill caches and aren't recorded.
+    if(i < 0) continue;
+    wall[i] = wall_end - wall_start;
+    cpu    += cpu_end - cpu_start;
+    if(text) {
       printf("\x1b[1;32m.\x1b[0m");
       fflush(stdout);
-      bench->teardown(data);
     }
-    printf("\nCompleted %i runs in %f seconds (%f r/s)\n",
-                            bench->times, sum(runs, bench->times),
-                            bench->times / sum(runs, bench->times));
-    printf("\x1b[33mmean\x1b[0m: %f\n", mean(runs, bench->times));
-    printf("\x1b[33mstd\x1b[0m:  %f\n", stdev(runs, bench->times));
   }
+
+  memset(result, 0, sizeof(*result));
+  result->name       = bench->name;
+  result->runs       = opts->iterations;
+  result->wall_total = sum(wall, opts->iterations);
+  result->cpu_total  = cpu;
+  result->mean       = mean(wall, opts->iterations);
+  result->stdev      = stdev(wall, opts->iterations);
+  qsort(wall, opts->iterations, sizeof(*wall), compare_doubles);
+  result->p50 = percentile(wall, opts->iterations, 50);
+  result->p95 = percentile(wall, opts->iterations, 95);
+  result->p99 = percentile(wall, opts->iterations, 99);
+  result->tiles_per_sec = result->wall_total > 0 ? opts->iterations / result->wall_total : 0;
+  result->peak_rss_kb   = peak_rss_kb();
+}
+
+static void
+print_text(result_t *result){
+  printf("\nCompleted %i runs in %f seconds (%f r/s), %f seconds of cpu\n",
+    result->runs, result->wall_total, result->tiles_per_sec, result->cpu_total);
+  printf("\x1b[33mmean\x1b[0m: %f\n", result->mean);
+  printf("\x1b[33mstd\x1b[0m:  %f\n", result->stdev);
+  printf("\x1b[33mp50\x1b[0m:  %f\n", result->p50);
+  printf("\x1b[33mp95\x1b[0m:  %f\n", result->p95);
+  printf("\x1b[33mp99\x1b[0m:  %f\n", result->p99);
+  printf("\x1b[33mrss\x1b[0m:  %ld kB peak\n", result->peak_rss_kb);
+}
+
+static void
+print_json(result_t *result, int first){
+  printf("%s\n  {\"name\": \"%s\", \"runs\": %i, \"wall_total\": %f, \"cpu_total\": %f, "
+    "\"mean\": %f, \"stdev\": %f, \"p50\": %f, \"p95\": %f, \"p99\": %f, "
+    "\"tiles_per_sec\": %f, \"peak_rss_kb\": %ld}",
+    first ? "" : ",", result->name, result->runs, result->wall_total, result->cpu_total,
+    result->mean, result->stdev, result->p50, result->p95, result->p99,
+    result->tiles_per_sec, result->peak_rss_kb);
+}
+
+static void
+print_csv(result_t *result){
+  printf("%s,%i,%f,%f,%f,%f,%f,%f,%f,%f,%ld\n",
+    result->name, result->runs, result->wall_total, result->cpu_total,
+    result->mean, result->stdev, result->p50, result->p95, result->p99,
+    result->tiles_per_sec, result->peak_rss_kb);
+}
+
+static void
+usage(const char *program){
+  fprintf(stderr,
+    "usage: %s [-n iterations] [-w warmup] [-f name] [-o text|json|csv] [-l]\n"
+    "  -n  timed runs of each benchmark (default 10)\n"
+    "  -w  untimed runs before timing starts (default 1)\n"
+    "  -f  only run benchmarks whose name contains this string\n"
+    "  -o  output format (default text)\n"
+    "  -l  list the benchmarks and exit\n", program);
+}
+
+int
+main(int argc, char **argv){
+  options_t opts = { 10, 1, NULL, FORMAT_TEXT };
+  bench_wrap_t *bench;
+  int opt;
+  while((opt = getopt(argc, argv, "n:w:f:o:l")) != -1){
+    switch(opt){
+      case 'n':
+        opts.iterations = atoi(optarg);
+        break;
+      case 'w':
+        opts.warmup = atoi(optarg);
+        break;
+      case 'f':
+        opts.filter = optarg;
+        break;
+      case 'o':
+        if(!strcmp(optarg, "json"))
+          opts.format = FORMAT_JSON;
+        else if(!strcmp(optarg, "csv"))
+          opts.format = FORMAT_CSV;
+        else if(!strcmp(optarg, "text"))
+          opts.format = FORMAT_TEXT;
+        else {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'l':
+        for(bench = benchmarks; bench->call; bench++)
+          puts(bench->name);
+        return 0;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(opts.iterations < 1 || opts.warmup < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if(opts.format == FORMAT_JSON)
+    printf("[");
+  else if(opts.format == FORMAT_CSV)
+    puts("name,runs,wall_total,cpu_total,mean,stdev,p50,p95,p99,tiles_per_sec,peak_rss_kb");
+
+  int first = 1;
+  for(bench = benchmarks; bench->call; bench++){
+    if(opts.filter && !strstr(bench->name, opts.filter)) continue;
+
+    result_t result;
+    run(bench, &opts, &result);
+    switch(opts.format){
+      case FORMAT_TEXT:
+        print_text(&result);
+        break;
+      case FORMAT_JSON:
+        print_json(&result, first);
+        break;
+      case FORMAT_CSV:
+        print_csv(&result);
+        break;
+    }
+    first = 0;
+  }
+
+  if(opts.format == FORMAT_JSON)
+    printf("\n]\n");
+  return 0;
 }
@@ -0,0 +1,286 @@
+#define _XOPEN_SOURCE 700
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <ogr_api.h>
+#include <ogr_srs_api.h>
+
+// Writes deterministic synthetic datasets for benchmarking without network
+// access. The same options and seed always produce the same features.
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Features are committed in batches, which keeps GeoPackage writes fast.
+#define BATCH_SIZE 10000
+
+typedef enum {
+  GEN_POINT,
+  GEN_LINE,
+  GEN_POLYGON
+} kind_t;
+
+typedef struct {
+  const char *path;
+  const char *driver;
+  kind_t kind;
+  long features;
+  long vertices;
+  int label_length;
+  double radius;
+  double minx, miny, maxx, maxy;
+  unsigned long long seed;
+} options_t;
+
+// A 64 bit xorshift generator, so output doesn't depend on the C library's
+// rand.
+static unsigned long long state;
+
+static double
+uniform(){
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return (state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double
+between(double min, double max){
+  return min + (max - min) * uniform();
+}
+
+// Fill label with length characters of capitalized pseudo words.
+static void
+make_label(char *label, int length){
+  int word = 0;
+  for(int i = 0; i < length; i++){
+    if(word > 2 && i < length - 1 && uniform() < 0.2) {
+      label[i] = ' ';
+      word = 0;
+      continue;
+    }
+    label[i] = (word ? 'a' : 'A') + (int) (uniform() * 26);
+    word++;
+  }
+  label[length] = '\0';
+}
+
+static OGRGeometryH
+make_point(options_t *opts){
+  OGRGeometryH point = OGR_G_CreateGeometry(wkbPoint);
+  OGR_G_AddPoint_2D(point, between(opts->minx, opts->maxx), between(opts->miny, opts->maxy));
+  return point;
+}
+
+// A random walk of vertices points starting anywhere in the extent.
+static OGRGeometryH
+make_line(options_t *opts){
+  OGRGeometryH line = OGR_G_CreateGeometry(wkbLineString);
+  double x = between(opts->minx, opts->maxx), y = between(opts->miny, opts->maxy);
+  double step = opts->radius * 2 / opts->vertices;
+  for(long i = 0; i < opts->vertices; i++){
+    OGR_G_AddPoint_2D(line, x, y);
+    double angle = between(0, 2 * M_PI);
+    x += cos(angle) * step;
+    y += sin(angle) * step;
+  }
+  return line;
+}
+
+// A star shaped polygon of vertices points around a center in the extent.
+// Vertices are in angle order, so the ring never crosses itself.
+static OGRGeometryH
+make_polygon(options_t *opts){
+  OGRGeometryH polygon = OGR_G_CreateGeometry(wkbPolygon);
+  OGRGeometryH ring = OGR_G_CreateGeometry(wkbLinearRing);
+  double cx = between(opts->minx, opts->maxx), cy = between(opts->miny, opts->maxy);
+  double first_x = 0, first_y = 0;
+  for(long i = 0; i < opts->vertices; i++){
+    double angle = 2 * M_PI * i / opts->vertices;
+    double r = opts->radius * between(0.6, 1.0);
+    double x = cx + cos(angle) * r, y = cy + sin(angle) * r;
+    if(!i) first_x = x, first_y = y;
+    OGR_G_AddPoint_2D(ring, x, y);
+  }
+  OGR_G_AddPoint_2D(ring, first_x, first_y);
+  OGR_G_AddGeometryDirectly(polygon, ring);
+  return polygon;
+}
+
+// Name the layer after the file, without its directory or extension, which
+// is what OGR calls a shapefile's layer.
+static char *
+layer_name(const char *path){
+  const char *base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  char *name = malloc(strlen(base) + 1);
+  if(!name) return NULL;
+  strcpy(name, base);
+  char *dot = strrchr(name, '.');
+  if(dot && dot != name) *dot = '\0';
+  return name;
+}
+
+static int
+generate(options_t *opts){
+  OGRRegisterAll();
+  OGRSFDriverH driver;
+  if(!(driver = OGRGetDriverByName(opts->driver))) {
+    fprintf(stderr, "no OGR driver named %s\n", opts->driver);
+    return 1;
+  }
+
+  // Replace any earlier output.
+  if(!access(opts->path, F_OK))
+    OGR_Dr_DeleteDataSource(driver, opts->path);
+
+  OGRDataSourceH source;
+  if(!(source = OGR_Dr_CreateDataSource(driver, opts->path, NULL))) {
+    fprintf(stderr, "could not create %s\n", opts->path);
+    return 1;
+  }
+
+  OGRSpatialReferenceH srs = OSRNewSpatialReference(NULL);
+  OSRSetWellKnownGeogCS(srs, "WGS84");
+
+  static const OGRwkbGeometryType types[] = { wkbPoint, wkbLineString, wkbPolygon };
+  char *name = layer_name(opts->path);
+  OGRLayerH layer = name ? OGR_DS_CreateLayer(source, name, srs, types[opts->kind], NULL) : NULL;
+  free(name);
+  OSRRelease(srs);
+  if(!layer) {
+    fprintf(stderr, "could not create a layer in %s\n", opts->path);
+    OGR_DS_Destroy(source);
+    return 1;
+  }
+
+  // NAME holds the label text and RANK a priority, larger for earlier
+  // features.
+  OGRFieldDefnH field = OGR_Fld_Create("NAME", OFTString);
+  OGR_Fld_SetWidth(field, opts->label_length > 0 ? opts->label_length : 1);
+  OGR_L_CreateField(layer, field, 1);
+  OGR_Fld_Destroy(field);
+  field = OGR_Fld_Create("RANK", OFTInteger);
+  OGR_L_CreateField(layer, field, 1);
+  OGR_Fld_Destroy(field);
+
+  char label[256];
+  OGRFeatureDefnH defn = OGR_L_GetLayerDefn(layer);
+  int status = 0;
+  state = opts->seed ? opts->seed : 1;
+  OGR_L_StartTransaction(layer);
+  for(long i = 0; i < opts->features; i++){
+    OGRGeometryH geom;
+    switch(opts->kind){
+      case GEN_POINT:
+        geom = make_point(opts);
+        break;
+      case GEN_LINE:
+        geom = make_line(opts);
+        break;
+      default:
+        geom = make_polygon(opts);
+    }
+
+    OGRFeatureH feature = OGR_F_Create(defn);
+    make_label(label, opts->label_length);
+    OGR_F_SetFieldString(feature, 0, label);
+    OGR_F_SetFieldInteger(feature, 1, (int) (opts->features - i));
+    OGR_F_SetGeometryDirectly(feature, geom);
+    if(OGR_L_CreateFeature(layer, feature) != OGRERR_NONE) {
+      fprintf(stderr, "could not write feature %ld\n", i);
+      OGR_F_Destroy(feature);
+      status = 1;
+      break;
+    }
+    OGR_F_Destroy(feature);
+
+    if((i + 1) % BATCH_SIZE == 0) {
+      OGR_L_CommitTransaction(layer);
+      OGR_L_StartTransaction(layer);
+    }
+  }
+  OGR_L_CommitTransaction(layer);
+  OGR_DS_Destroy(source);
+  return status;
+}
+
+static void
+usage(const char *program){
+  fprintf(stderr,
+    "usage: %s -o path [-t point|line|polygon] [-n features] [-v vertices]\n"
+    "          [-l label length] [-r radius] [-e minx,miny,maxx,maxy] [-s seed]\n"
+    "  -o  output file, .gpkg files are written as GeoPackages, others as shapefiles\n"
+    "  -t  geometry type (default polygon)\n"
+    "  -n  number of features (default 1000)\n"
+    "  -v  vertices per line or polygon (default 100)\n"
+    "  -l  characters in each NAME label, at most 254 (default 10)\n"
+    "  -r  size of lines and polygons in degrees (default 1)\n"
+    "  -e  extent features are placed in (default the whole world)\n"
+    "  -s  random seed (default 1)\n", program);
+}
+
+int
+main(int argc, char **argv){
+  options_t opts = { NULL, "ESRI Shapefile", GEN_POLYGON, 1000, 100, 10, 1,
+    -180, -85, 180, 85, 1 };
+  int opt;
+  while((opt = getopt(argc, argv, "o:t:n:v:l:r:e:s:")) != -1){
+    switch(opt){
+      case 'o':
+        opts.path = optarg;
+        break;
+      case 't':
+        if(!strcmp(optarg, "point"))
+          opts.kind = GEN_POINT;
+        else if(!strcmp(optarg, "line"))
+          opts.kind = GEN_LINE;
+        else if(!strcmp(optarg, "polygon"))
+          opts.kind = GEN_POLYGON;
+        else {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'n':
+        opts.features = atol(optarg);
+        break;
+      case 'v':
+        opts.vertices = atol(optarg);
+        break;
+      case 'l':
+        opts.label_length = atoi(optarg);
+        break;
+      case 'r':
+        opts.radius = atof(optarg);
+        break;
+      case 'e':
+        if(sscanf(optarg, "%lf,%lf,%lf,%lf", &opts.minx, &opts.miny, &opts.maxx, &opts.maxy) != 4) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 's':
+        opts.seed = strtoull(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(!opts.path || opts.features < 0 || opts.vertices < 3
+    || opts.label_length < 0 || opts.label_length > 254) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  size_t length = strlen(opts.path);
+  if(length > 5 && !strcmp(opts.path + length - 5, ".gpkg"))
+    opts.driver = "GPKG";
+
+  return generate(&opts);
+}
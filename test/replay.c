@@ -0,0 +1,457 @@
+#define _XOPEN_SOURCE 700
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <simple-tiles/simple_tiles.h>
+#include <simple-tiles/filter.h>
+#include <simple-tiles/layer.h>
+
+// Replays a file of tile requests against a map with a pool of concurrent
+// renders, and reports throughput, latency by zoom and where the time went.
+//
+// The map is described by a config file, one directive per line:
+//
+//   # comments and blank lines are ignored
+//   bgcolor #ddeeff
+//   buffer 10
+//   layer ../data/ne_10m_admin_0_countries.shp
+//   filter SELECT * from 'ne_10m_admin_0_countries'
+//   style fill #061F37ff
+//
+// A filter belongs to the last layer and a style to the last filter. Each line
+// of the request file holds a tile as z/x/y, anywhere in the line, so access
+// logs can be replayed as they are.
+
+#define MAX_LINE 4096
+
+typedef struct {
+  unsigned int z, x, y;
+} request_t;
+
+// What happened to one request.
+typedef struct {
+  double latency;
+  simplet_status_t status;
+  simplet_stats_t stats;
+} result_t;
+
+typedef struct {
+  int workers;
+  int repeat;
+  int json;
+} options_t;
+
+// Shared by the workers, which take the next request under the lock.
+typedef struct {
+  simplet_map_t *map;
+  request_t *requests;
+  result_t *results;
+  long length;
+  long next;
+  int failed; // set when a worker couldn't start
+  pthread_mutex_t lock;
+} replay_t;
+
+static double
+seconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static cairo_status_t
+stream(void *closure, const unsigned char *data, unsigned int length){
+  (void) closure, (void) data, (void) length;  /* suppress warnings */
+  return CAIRO_STATUS_SUCCESS;
+}
+
+// Strip trailing whitespace and return the start of the first word.
+static char *
+trim(char *line){
+  size_t length = strlen(line);
+  while(length && isspace((unsigned char) line[length - 1]))
+    line[--length] = '\0';
+  while(isspace((unsigned char) *line)) line++;
+  return line;
+}
+
+// Build a slippy map from a config file, returns NULL and prints the problem
+// on failure.
+static simplet_map_t *
+load_map(const char *path){
+  FILE *file;
+  if(!(file = fopen(path, "r"))) {
+    perror(path);
+    return NULL;
+  }
+
+  simplet_map_t *map;
+  if(!(map = simplet_map_new())) {
+    fclose(file);
+    return NULL;
+  }
+  simplet_map_set_slippy(map, 0, 0, 0);
+
+  simplet_layer_t *layer   = NULL;
+  simplet_filter_t *filter = NULL;
+  char buf[MAX_LINE];
+  int number = 0, ok = 1;
+  while(ok && fgets(buf, sizeof(buf), file)){
+    number++;
+    char *line = trim(buf);
+    if(!*line || *line == '#') continue;
+
+    char *arg = line;
+    while(*arg && !isspace((unsigned char) *arg)) arg++;
+    if(*arg) *arg++ = '\0';
+    arg = trim(arg);
+
+    if(!strcmp(line, "layer")) {
+      ok = (layer = simplet_map_add_layer(map, arg)) != NULL;
+      filter = NULL;
+    } else if(!strcmp(line, "filter") && layer) {
+      ok = (filter = simplet_layer_add_filter(layer, arg)) != NULL;
+    } else if(!strcmp(line, "style") && filter) {
+      char *value = arg;
+      while(*value && !isspace((unsigned char) *value)) value++;
+      if(*value) *value++ = '\0';
+      ok = simplet_filter_add_style(filter, arg, trim(value)) != NULL;
+    } else if(!strcmp(line, "bgcolor")) {
+      ok = simplet_map_set_bgcolor(map, arg) == SIMPLET_OK;
+    } else if(!strcmp(line, "buffer")) {
+      simplet_map_set_buffer(map, atof(arg));
+    } else {
+      ok = 0;
+    }
+    if(!ok) fprintf(stderr, "%s:%i: can't use \"%s\"\n", path, number, line);
+  }
+  fclose(file);
+
+  if(ok && simplet_map_is_valid(map) != SIMPLET_OK) {
+    fprintf(stderr, "%s: %s\n", path, simplet_map_status_to_string(map));
+    ok = 0;
+  }
+
+  if(!ok) {
+    simplet_map_free(map);
+    return NULL;
+  }
+  return map;
+}
+
+// Find the first z/x/y in a line.
+static int
+parse_request(const char *line, request_t *request){
+  for(const char *c = line; *c; c++){
+    if(!isdigit((unsigned char) *c) || (c > line && isdigit((unsigned char) c[-1])))
+      continue;
+    if(sscanf(c, "%u/%u/%u", &request->z, &request->x, &request->y) == 3
+      && request->z < 32 && request->x < (1u << request->z) && request->y < (1u << request->z))
+      return 1;
+  }
+  return 0;
+}
+
+// Read every request in path, repeated repeat times, into requests. Returns
+// the number of requests, or -1 on failure.
+static long
+load_requests(const char *path, int repeat, request_t **requests){
+  FILE *file;
+  if(!(file = fopen(path, "r"))) {
+    perror(path);
+    return -1;
+  }
+
+  long length = 0, size = 1024;
+  request_t *list = malloc(size * sizeof(*list));
+  char buf[MAX_LINE];
+  while(list && fgets(buf, sizeof(buf), file)){
+    if(length == size) {
+      request_t *grown;
+      if(!(grown = realloc(list, (size *= 2) * sizeof(*list)))) {
+        free(list);
+        list = NULL;
+        break;
+      }
+      list = grown;
+    }
+    if(parse_request(buf, &list[length])) length++;
+  }
+  fclose(file);
+  if(!list) return -1;
+
+  request_t *repeated;
+  if(!(repeated = realloc(list, (length * repeat + 1) * sizeof(*list)))) {
+    free(list);
+    return -1;
+  }
+  for(int i = 1; i < repeat; i++)
+    memcpy(repeated + i * length, repeated, length * sizeof(*repeated));
+
+  *requests = repeated;
+  return length * repeat;
+}
+
+// Render requests until there are none left, each worker has its own render
+// so the arena and spatial reference are reused between its tiles.
+static void *
+work(void *ctx){
+  replay_t *replay = ctx;
+  simplet_render_t render;
+  if(simplet_render_init(&render, replay->map) != SIMPLET_OK) {
+    fprintf(stderr, "couldn't start a worker: %s\n", simplet_render_status_to_string(&render));
+    pthread_mutex_lock(&replay->lock);
+    replay->failed = 1;
+    pthread_mutex_unlock(&replay->lock);
+    simplet_render_release(&render);
+    return NULL;
+  }
+
+  for(;;){
+    pthread_mutex_lock(&replay->lock);
+    long i = replay->next < replay->length ? replay->next++ : -1;
+    pthread_mutex_unlock(&replay->lock);
+    if(i < 0) break;
+
+    request_t *request = &replay->requests[i];
+    result_t *result   = &replay->results[i];
+    simplet_render_reset(&render);
+    if(simplet_render_set_slippy(&render, request->x, request->y, request->z) != SIMPLET_OK) {
+      result->status = simplet_render_get_status(&render);
+      continue;
+    }
+
+    double start = seconds();
+    result->status  = simplet_render_to_stream(&render, NULL, stream);
+    result->latency = seconds() - start;
+    simplet_render_get_stats(&render, &result->stats);
+  }
+
+  simplet_render_release(&render);
+  return NULL;
+}
+
+static int
+compare_doubles(const void *a, const void *b){
+  double da = *(const double *) a, db = *(const double *) b;
+  return (da > db) - (da < db);
+}
+
+// The nearest rank percentile of sorted, which holds count values.
+static double
+percentile(double *sorted, long count, double pct){
+  long rank = (long) ceil(pct / 100 * count);
+  if(rank < 1) rank = 1;
+  return sorted[rank - 1];
+}
+
+// Latencies of the requests at zoom, or every zoom if zoom is negative.
+typedef struct {
+  int zoom;
+  long count;
+  long errors;
+  double mean, p50, p95, p99, max;
+} latency_t;
+
+static void
+summarize(result_t *results, request_t *requests, long length, int zoom, latency_t *latency){
+  double *sorted = malloc((length + 1) * sizeof(*sorted));
+  double total = 0;
+  memset(latency, 0, sizeof(*latency));
+  latency->zoom = zoom;
+  for(long i = 0; i < length && sorted; i++){
+    if(zoom >= 0 && requests[i].z != (unsigned int) zoom) continue;
+    if(results[i].status != SIMPLET_OK) latency->errors++;
+    sorted[latency->count++] = results[i].latency;
+    total += results[i].latency;
+  }
+
+  if(latency->count) {
+    qsort(sorted, latency->count, sizeof(*sorted), compare_doubles);
+    latency->mean = total / latency->count;
+    latency->p50  = percentile(sorted, latency->count, 50);
+    latency->p95  = percentile(sorted, latency->count, 95);
+    latency->p99  = percentile(sorted, latency->count, 99);
+    latency->max  = sorted[latency->count - 1];
+  }
+  free(sorted);
+}
+
+// The stages of simplet_stats_t, by name.
+typedef struct {
+  const char *name;
+  size_t offset;
+} stage_t;
+
+#define STAGE(field) { #field, offsetof(simplet_stats_t, field##_time) }
+static stage_t stages[] = {
+  STAGE(open),
+  STAGE(query),
+  STAGE(transform),
+  STAGE(plot),
+  STAGE(label),
+  STAGE(composite),
+  STAGE(encode),
+  { NULL, 0 }
+};
+
+// Sum a stage's seconds across all the requests.
+static double
+stage_total(result_t *results, long length, stage_t *stage){
+  double total = 0;
+  for(long i = 0; i < length; i++)
+    total += *(double *) ((char *) &results[i].stats + stage->offset);
+  return total;
+}
+
+static void
+print_text(replay_t *replay, options_t *opts, double wall){
+  latency_t latency;
+  summarize(replay->results, replay->requests, replay->length, -1, &latency);
+  printf("Replayed %li requests with %i workers in %f seconds (%f r/s), %li errors\n",
+    replay->length, opts->workers, wall, replay->length / wall, latency.errors);
+
+  printf("\n%-6s %8s %8s %10s %10s %10s %10s %10s\n",
+    "zoom", "count", "errors", "mean", "p50", "p95", "p99", "max");
+  for(int zoom = -1; zoom < 32; zoom++){
+    summarize(replay->results, replay->requests, replay->length, zoom, &latency);
+    if(!latency.count) continue;
+    if(zoom < 0)
+      printf("%-6s", "all");
+    else
+      printf("%-6i", zoom);
+    printf(" %8li %8li %10f %10f %10f %10f %10f\n", latency.count, latency.errors,
+      latency.mean, latency.p50, latency.p95, latency.p99, latency.max);
+  }
+
+  double total = 0;
+  for(stage_t *stage = stages; stage->name; stage++)
+    total += stage_total(replay->results, replay->length, stage);
+  printf("\n%-10s %12s %12s %8s\n", "stage", "seconds", "per tile", "share");
+  for(stage_t *stage = stages; stage->name; stage++){
+    double seconds = stage_total(replay->results, replay->length, stage);
+    printf("%-10s %12f %12f %7.1f%%\n", stage->name, seconds, seconds / replay->length,
+      total > 0 ? seconds / total * 100 : 0);
+  }
+}
+
+static void
+print_json(replay_t *replay, options_t *opts, double wall){
+  latency_t latency;
+  summarize(replay->results, replay->requests, replay->length, -1, &latency);
+  printf("{\"requests\": %li, \"workers\": %i, \"wall\": %f, \"tiles_per_sec\": %f, \"errors\": %li,\n",
+    replay->length, opts->workers, wall, replay->length / wall, latency.errors);
+
+  printf(" \"latency\": [");
+  int first = 1;
+  for(int zoom = -1; zoom < 32; zoom++){
+    summarize(replay->results, replay->requests, replay->length, zoom, &latency);
+    if(!latency.count) continue;
+    printf("%s\n  {\"zoom\": ", first ? "" : ",");
+    if(zoom < 0)
+      printf("\"all\"");
+    else
+      printf("%i", zoom);
+    printf(", \"count\": %li, \"errors\": %li, \"mean\": %f, \"p50\": %f, \"p95\": %f, "
+      "\"p99\": %f, \"max\": %f}", latency.count, latency.errors, latency.mean,
+      latency.p50, latency.p95, latency.p99, latency.max);
+    first = 0;
+  }
+
+  printf("],\n \"stages\": {");
+  for(stage_t *stage = stages; stage->name; stage++)
+    printf("%s\"%s\": %f", stage == stages ? "" : ", ", stage->name,
+      stage_total(replay->results, replay->length, stage));
+  printf("}}\n");
+}
+
+static void
+usage(const char *program){
+  fprintf(stderr,
+    "usage: %s -c config [-j workers] [-n repeat] [-o text|json] requests\n"
+    "  -c  map config, see the top of replay.c\n"
+    "  -j  concurrent renders (default 4)\n"
+    "  -n  times to replay the requests (default 1)\n"
+    "  -o  output format (default text)\n", program);
+}
+
+int
+main(int argc, char **argv){
+  options_t opts = { 4, 1, 0 };
+  const char *config = NULL;
+  int opt;
+  while((opt = getopt(argc, argv, "c:j:n:o:")) != -1){
+    switch(opt){
+      case 'c':
+        config = optarg;
+        break;
+      case 'j':
+        opts.workers = atoi(optarg);
+        break;
+      case 'n':
+        opts.repeat = atoi(optarg);
+        break;
+      case 'o':
+        if(!strcmp(optarg, "json"))
+          opts.json = 1;
+        else if(!strcmp(optarg, "text"))
+          opts.json = 0;
+        else {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(!config || optind != argc - 1 || opts.workers < 1 || opts.repeat < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  replay_t replay;
+  memset(&replay, 0, sizeof(replay));
+  pthread_mutex_init(&replay.lock, NULL);
+  if(!(replay.map = load_map(config)))
+    return 1;
+  if((replay.length = load_requests(argv[optind], opts.repeat, &replay.requests)) <= 0) {
+    fprintf(stderr, "%s: no z/x/y requests\n", argv[optind]);
+    simplet_map_free(replay.map);
+    return 1;
+  }
+  if(!(replay.results = calloc(replay.length, sizeof(*replay.results)))) {
+    simplet_map_free(replay.map);
+    return 1;
+  }
+
+  pthread_t threads[opts.workers];
+  double start = seconds();
+  for(int i = 0; i < opts.workers; i++)
+    pthread_create(&threads[i], NULL, work, &replay);
+  for(int i = 0; i < opts.workers; i++)
+    pthread_join(threads[i], NULL);
+  double wall = seconds() - start;
+
+  // Requests left to the other workers are still timed, but the run isn't
+  // the one asked for.
+  int status = replay.failed;
+  if(opts.json)
+    print_json(&replay, &opts, wall);
+  else
+    print_text(&replay, &opts, wall);
+
+  free(replay.results);
+  free(replay.requests);
+  simplet_map_free(replay.map);
+  pthread_mutex_destroy(&replay.lock);
+  return status;
+}
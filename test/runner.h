@@ -15,10 +15,18 @@ typedef struct {
 task_wrap_t tasks[] = {
   TASK_ENTRY(list)
   TASK_ENTRY(bounds)
+  TASK_ENTRY(grid)
+  TASK_ENTRY(arena)
+  TASK_ENTRY(alloc)
   TASK_ENTRY(layer)
   TASK_ENTRY(filter)
   TASK_ENTRY(style)
+  TASK_ENTRY(shape)
+  TASK_ENTRY(text)
+  TASK_ENTRY(anchor)
+  TASK_ENTRY(expr)
   TASK_ENTRY(map)
+  TASK_ENTRY(render)
   TASK_ENTRY(integration)
   { NULL, NULL }
 };
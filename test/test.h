@@ -21,5 +21,13 @@ TASK(style);
 TASK(map);
 TASK(integration);
 TASK(bounds);
+TASK(grid);
+TASK(expr);
+TASK(render);
+TASK(shape);
+TASK(text);
+TASK(anchor);
+TASK(arena);
+TASK(alloc);
 
 #endif
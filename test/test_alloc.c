@@ -0,0 +1,57 @@
+#include <simple-tiles/alloc.h>
+#include <simple-tiles/layer.h>
+#include <simple-tiles/filter.h>
+#include "test.h"
+
+typedef struct {
+  int calls;
+  int live;
+} counter_t;
+
+static void *
+counting_malloc(size_t size, void *ctx){
+  counter_t *counter = ctx;
+  counter->calls++;
+  counter->live++;
+  return malloc(size);
+}
+
+static void *
+counting_realloc(void *ptr, size_t size, void *ctx){
+  counter_t *counter = ctx;
+  counter->calls++;
+  if(!ptr) counter->live++;
+  return realloc(ptr, size);
+}
+
+static void
+counting_free(void *ptr, void *ctx){
+  counter_t *counter = ctx;
+  counter->live--;
+  free(ptr);
+}
+
+void
+test_set_allocator(){
+  counter_t counter = { 0, 0 };
+  simplet_set_allocator(counting_malloc, counting_realloc, counting_free, &counter);
+
+  simplet_map_t *map;
+  assert((map = simplet_map_new()));
+  simplet_layer_t *layer = simplet_map_add_layer(map, "../data/10m_admin_0_countries.shp");
+  simplet_filter_t *filter = simplet_layer_add_filter(layer, "SELECT * FROM '10m_admin_0_countries'");
+  simplet_filter_add_style(filter, "fill", "#061F3799");
+  char *query;
+  simplet_filter_get_query(filter, &query);
+  simplet_free(query);
+  simplet_map_free(map);
+
+  // Everything simple-tiles allocated went through the hooks and was freed.
+  simplet_set_allocator(NULL, NULL, NULL, NULL);
+  assert(counter.calls > 0);
+  assert(counter.live == 0);
+}
+
+TASK(alloc){
+  test(set_allocator);
+}
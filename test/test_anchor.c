@@ -0,0 +1,89 @@
+#include <simple-tiles/anchor.h>
+#include <simple-tiles/map.h>
+#include "test.h"
+
+static OGRGeometryH
+square(double size){
+  char wkt[128];
+  char *cursor = wkt;
+  snprintf(wkt, sizeof(wkt), "POLYGON ((0 0, %f 0, %f %f, 0 %f, 0 0))", size, size, size, size);
+  OGRGeometryH geom = NULL;
+  OGR_G_CreateFromWkt(&cursor, NULL, &geom);
+  return geom;
+}
+
+void
+test_anchor_cache(){
+  simplet_map_t *map;
+  assert((map = simplet_map_new())); /* initializes OGR */
+
+  OGRFeatureDefnH defn = OGR_FD_Create("anchors");
+  OGR_FD_Reference(defn);
+  OGRFeatureH feature = OGR_F_Create(defn);
+  OGR_F_SetFID(feature, 7);
+  OGR_F_SetGeometryDirectly(feature, square(2));
+
+  unsigned int ns = simplet_anchor_namespace("test source", "SELECT * FROM anchors");
+  assert(ns);
+  assert(ns == simplet_anchor_namespace("test source", "SELECT * FROM anchors"));
+  assert(ns != simplet_anchor_namespace("test source", "SELECT * FROM others"));
+
+  double x, y;
+  assert(simplet_anchor_find(ns, feature, NULL, &x, &y));
+  assert(x == 1 && y == 1);
+
+  // The cached anchor is used while the envelope is the same, so a feature
+  // isn't measured again.
+  unsigned long hits, misses, last_hits, last_misses;
+  simplet_anchor_cache_get_counts(&last_hits, &last_misses);
+  OGR_F_SetGeometryDirectly(feature, square(2));
+  assert(simplet_anchor_find(ns, feature, NULL, &x, &y));
+  assert(x == 1 && y == 1);
+  simplet_anchor_cache_get_counts(&hits, &misses);
+  assert(hits == last_hits + 1 && misses == last_misses);
+
+  // Without a namespace the anchor is measured again.
+  OGR_F_SetGeometryDirectly(feature, square(4));
+  assert(simplet_anchor_find(0, feature, NULL, &x, &y));
+  assert(x == 2 && y == 2);
+
+  OGR_F_Destroy(feature);
+  OGR_FD_Release(defn);
+  simplet_map_free(map);
+}
+
+// Drivers that number the rows of each result can hand back a different
+// feature under the same FID when the same query runs against another tile.
+void
+test_anchor_reused_fid(){
+  simplet_map_t *map;
+  assert((map = simplet_map_new())); /* initializes OGR */
+
+  OGRFeatureDefnH defn = OGR_FD_Create("rows");
+  OGR_FD_Reference(defn);
+  OGRFeatureH first = OGR_F_Create(defn);
+  OGRFeatureH second = OGR_F_Create(defn);
+  OGR_F_SetFID(first, 0);
+  OGR_F_SetFID(second, 0);
+  OGR_F_SetGeometryDirectly(first, square(2));
+  OGR_F_SetGeometryDirectly(second, square(6));
+
+  unsigned int ns = simplet_anchor_namespace("row source", "SELECT * FROM rows");
+  double x, y;
+  assert(simplet_anchor_find(ns, first, NULL, &x, &y));
+  assert(x == 1 && y == 1);
+  assert(simplet_anchor_find(ns, second, NULL, &x, &y));
+  assert(x == 3 && y == 3);
+  assert(simplet_anchor_find(ns, first, NULL, &x, &y));
+  assert(x == 1 && y == 1);
+
+  OGR_F_Destroy(first);
+  OGR_F_Destroy(second);
+  OGR_FD_Release(defn);
+  simplet_map_free(map);
+}
+
+TASK(anchor){
+  test(anchor_cache);
+  test(anchor_reused_fid);
+}
@@ -0,0 +1,47 @@
+#include <string.h>
+#include <stdint.h>
+#include <simple-tiles/arena.h>
+#include "test.h"
+
+void
+test_arena_alloc(){
+  simplet_arena_t *arena;
+  assert((arena = simplet_arena_new(64)));
+  char *a = simplet_arena_alloc(arena, 3);
+  double *b = simplet_arena_alloc(arena, sizeof(*b));
+  assert(a && b);
+  assert((uintptr_t) b % sizeof(*b) == 0);
+  *b = 1.5;
+  memset(a, 'a', 3);
+  assert(*b == 1.5);
+
+  // Allocations bigger than a block get a block of their own.
+  char *big = simplet_arena_alloc(arena, 1000);
+  assert(big);
+  memset(big, 0, 1000);
+
+  char *copy = simplet_arena_strdup(arena, "Tokyo");
+  assert(!strcmp(copy, "Tokyo"));
+  simplet_arena_free(arena);
+}
+
+void
+test_arena_reset(){
+  simplet_arena_t *arena;
+  assert((arena = simplet_arena_new(64)));
+  void *first = simplet_arena_alloc(arena, 16);
+  for(int i = 0; i < 10; i++)
+    assert(simplet_arena_alloc(arena, 48));
+
+  // Memory is handed out again from the start once the arena is reset.
+  simplet_arena_reset(arena);
+  assert(simplet_arena_alloc(arena, 16) == first);
+  for(int i = 0; i < 10; i++)
+    assert(simplet_arena_alloc(arena, 48));
+  simplet_arena_free(arena);
+}
+
+TASK(arena){
+  test(arena_alloc);
+  test(arena_reset);
+}
@@ -1,4 +1,6 @@
+#include <string.h>
 #include <simple-tiles/bounds.h>
+#include <simple-tiles/alloc.h>
 #include "test.h"
 
 void
@@ -38,7 +40,21 @@ test_buffer(){
   simplet_bounds_free(unit);
 }
 
+void
+test_to_wkt(){
+  simplet_bounds_t *unit = simplet_bounds_new();
+  simplet_bounds_extend(unit, 1, 1);
+  simplet_bounds_extend(unit, -1, -1);
+  char *wkt;
+  assert(simplet_bounds_to_wkt(unit, &wkt) == SIMPLET_OK);
+  assert(!strcmp(wkt, "POLYGON ((1.000000 1.000000, 1.000000 -1.000000, "
+    "-1.000000 -1.000000, -1.000000 1.000000, 1.000000 1.000000))"));
+  simplet_free(wkt);
+  simplet_bounds_free(unit);
+}
+
 TASK(bounds){
   test(intersects);
   test(buffer);
+  test(to_wkt);
 }
@@ -0,0 +1,106 @@
+#include "test.h"
+#include <math.h>
+#include <simple-tiles/expr.h>
+
+static void
+test_parse(){
+  simplet_expr_t *expr;
+  assert(!simplet_expr_new("#cccccc"));
+  assert(!simplet_expr_new("match(TYPE)"));
+  assert(!simplet_expr_new("step(POP, 10:#ff0000, #cccccc)"));
+  assert(!simplet_expr_new("interpolate(POP, 10:1, 5:2)"));
+  assert(!simplet_expr_new("interpolate(POP, 0:1, 10:2"));
+
+  if(!(expr = simplet_expr_new(" match(TYPE, 'park':#00ff00, water:#0000ff80, #cccccc) ")))
+    assert(0);
+  assert(expr->type == SIMPLET_EXPR_MATCH);
+  assert(!strcmp(expr->field, "TYPE"));
+  assert(expr->length == 2);
+  assert(!strcmp(expr->stops[0].key, "park"));
+  assert(!strcmp(expr->stops[1].key, "water"));
+  assert(expr->stops[1].value[3] == 128 / 256.0);
+  assert(expr->has_fallback);
+  simplet_expr_free(expr);
+}
+
+static void
+test_match(){
+  simplet_expr_t *expr;
+  double value[4];
+  if(!(expr = simplet_expr_new("match(TYPE, park:#00ff00, water:#0000ff)")))
+    assert(0);
+  assert(simplet_expr_eval_string(expr, "park", value));
+  assert(value[1] == 255 / 256.0 && value[3] == 1.0);
+  assert(!simplet_expr_eval_string(expr, "road", value));
+  simplet_expr_free(expr);
+}
+
+static void
+test_match_number(){
+  simplet_expr_t *expr;
+  double value[4];
+  if(!(expr = simplet_expr_new("match(RANK, 1:10, 2.5:20, park:30, 0)")))
+    assert(0);
+  assert(expr->stops[0].numeric && expr->stops[1].numeric && !expr->stops[2].numeric);
+  assert(simplet_expr_eval_number(expr, 1.0, value) && value[0] == 10);
+  assert(simplet_expr_eval_number(expr, 2.5, value) && value[0] == 20);
+
+  // Keys that aren't numbers never match a numeric field, even 0.
+  assert(simplet_expr_eval_number(expr, 0, value) && value[0] == 0);
+  assert(simplet_expr_eval_number(expr, 3, value) && value[0] == 0);
+  simplet_expr_free(expr);
+}
+
+static void
+test_step(){
+  simplet_expr_t *expr;
+  double value[4];
+  if(!(expr = simplet_expr_new("step(POP, 1, 10:2, 100:3)")))
+    assert(0);
+  assert(simplet_expr_eval_number(expr, 5, value) && value[0] == 1);
+  assert(simplet_expr_eval_number(expr, 10, value) && value[0] == 2);
+  assert(simplet_expr_eval_number(expr, 99, value) && value[0] == 2);
+  assert(simplet_expr_eval_number(expr, 1000, value) && value[0] == 3);
+  simplet_expr_free(expr);
+}
+
+static void
+test_interpolate(){
+  simplet_expr_t *expr;
+  double value[4];
+  if(!(expr = simplet_expr_new("interpolate(POP, 0:0, 10:1, 20:3)")))
+    assert(0);
+  assert(simplet_expr_eval_number(expr, -5, value) && value[0] == 0);
+  assert(simplet_expr_eval_number(expr, 5, value) && value[0] == 0.5);
+  assert(simplet_expr_eval_number(expr, 15, value) && value[0] == 2);
+  assert(simplet_expr_eval_number(expr, 50, value) && value[0] == 3);
+  simplet_expr_free(expr);
+}
+
+static void
+test_nan(){
+  simplet_expr_t *step, *interpolate;
+  double value[4] = { 7, 7, 7, 7 };
+  if(!(step = simplet_expr_new("step(POP, 1, 10:2, 100:3)")))
+    assert(0);
+  if(!(interpolate = simplet_expr_new("interpolate(POP, 0:0, 10:1, 20:3)")))
+    assert(0);
+
+  // NaN is below no stop and above none, so only the fallback applies.
+  assert(simplet_expr_eval_number(step, NAN, value) && value[0] == 1);
+  assert(simplet_expr_eval_string(step, "nan", value) && value[0] == 1);
+  value[0] = 7;
+  assert(!simplet_expr_eval_number(interpolate, NAN, value) && value[0] == 7);
+  assert(!simplet_expr_eval_string(interpolate, "nan", value) && value[0] == 7);
+  simplet_expr_free(step);
+  simplet_expr_free(interpolate);
+}
+
+TASK(expr) {
+  test(parse);
+  test(match);
+  test(match_number);
+  test(step);
+  test(interpolate);
+  test(nan);
+}
@@ -50,8 +50,25 @@ test_query(){
   simplet_filter_free(filter);
 }
 
+static void
+test_zoom_range(){
+  simplet_filter_t *filter;
+  if(!(filter = simplet_filter_new("SELECT * FROM TEST;")))
+    assert(0);
+  assert(simplet_filter_is_visible(filter, 0));
+  assert(simplet_filter_is_visible(filter, 18));
+  simplet_filter_set_zoom_range(filter, 10, 14);
+  assert(!simplet_filter_is_visible(filter, 3));
+  assert(simplet_filter_is_visible(filter, 10));
+  assert(simplet_filter_is_visible(filter, 14));
+  assert(!simplet_filter_is_visible(filter, 15));
+  assert(simplet_filter_is_visible(filter, -1));
+  simplet_filter_free(filter);
+}
+
 TASK(filter) {
   test(filter);
   test(lookup);
   test(query);
+  test(zoom_range);
 }
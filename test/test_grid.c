@@ -0,0 +1,82 @@
+#include <simple-tiles/bounds.h>
+#include <simple-tiles/grid.h>
+#include "test.h"
+
+static simplet_bounds_t
+box(double maxx, double maxy, double minx, double miny){
+  simplet_bounds_t bounds;
+  simplet_bounds_init(&bounds);
+  simplet_bounds_extend(&bounds, maxx, maxy);
+  simplet_bounds_extend(&bounds, minx, miny);
+  return bounds;
+}
+
+void
+test_grid_intersects(){
+  simplet_grid_t *grid;
+  assert((grid = simplet_grid_new(10)));
+  simplet_bounds_t placed = box(25, 25, 5, 5);
+  assert(!simplet_grid_intersects(grid, &placed));
+  assert(simplet_grid_insert(grid, &placed) == SIMPLET_OK);
+
+  simplet_bounds_t near = box(40, 40, 26, 26);
+  simplet_bounds_t over = box(30, 30, 24, 24);
+  simplet_bounds_t negative = box(-1, -1, -40, -40);
+  assert(!simplet_grid_intersects(grid, &near));
+  assert(simplet_grid_intersects(grid, &over));
+  assert(!simplet_grid_intersects(grid, &negative));
+  assert(simplet_grid_insert(grid, &negative) == SIMPLET_OK);
+  assert(simplet_grid_intersects(grid, &negative));
+  simplet_grid_free(grid);
+}
+
+void
+test_grid_growth(){
+  simplet_grid_t *grid;
+  assert((grid = simplet_grid_new(8)));
+  // Fill enough cells to force the table to grow a few times.
+  for(int i = 0; i < 100; i++)
+    for(int j = 0; j < 100; j++){
+      simplet_bounds_t label = box(i * 10 + 8, j * 10 + 8, i * 10, j * 10);
+      assert(!simplet_grid_intersects(grid, &label));
+      assert(simplet_grid_insert(grid, &label) == SIMPLET_OK);
+    }
+  assert(grid->boxes_length == 10000);
+  simplet_bounds_t label = box(505, 505, 503, 503);
+  assert(simplet_grid_intersects(grid, &label));
+  label = box(509.5, 509.5, 508.5, 508.5);
+  assert(!simplet_grid_intersects(grid, &label));
+  simplet_grid_free(grid);
+}
+
+static void
+count_box(unsigned int box, void *data){
+  int *seen = data;
+  seen[box]++;
+}
+
+void
+test_grid_query(){
+  simplet_grid_t *grid;
+  assert((grid = simplet_grid_new(10)));
+  simplet_bounds_t wide  = box(45, 5, -5, 0);
+  simplet_bounds_t small = box(32, 32, 31, 31);
+  simplet_bounds_t far   = box(105, 105, 100, 100);
+  simplet_grid_insert(grid, &wide);
+  simplet_grid_insert(grid, &small);
+  simplet_grid_insert(grid, &far);
+
+  int seen[3] = { 0, 0, 0 };
+  simplet_bounds_t query = box(50, 50, 0, 0);
+  simplet_grid_query(grid, &query, count_box, seen);
+  assert(seen[0] == 1);
+  assert(seen[1] == 1);
+  assert(seen[2] == 0);
+  simplet_grid_free(grid);
+}
+
+TASK(grid){
+  test(grid_intersects);
+  test(grid_growth);
+  test(grid_query);
+}
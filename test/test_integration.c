@@ -1,10 +1,46 @@
+#include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <simple-tiles/map.h>
 #include <simple-tiles/layer.h>
 #include <simple-tiles/filter.h>
 #include <simple-tiles/list.h>
+#include <simple-tiles/labels.h>
+#include <simple-tiles/shape.h>
+#include <simple-tiles/trace.h>
+#include <simple-tiles/metrics.h>
+#include <simple-tiles/alloc.h>
 #include "test.h"
 
+// Read the pixel at x, y of the png at path as premultiplied 0xAARRGGBB.
+unsigned int
+pixel_at(const char *path, int x, int y){
+  cairo_surface_t *surface = cairo_image_surface_create_from_png(path);
+  assert(cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS);
+  cairo_surface_flush(surface);
+  unsigned char *data = cairo_image_surface_get_data(surface);
+  unsigned int pixel = *(uint32_t *) (data + y * cairo_image_surface_get_stride(surface) + x * 4);
+  cairo_surface_destroy(surface);
+  return pixel;
+}
+
+// Count the pixels of the png at path that aren't transparent, in the box
+// from x0, y0 up to but not including x1, y1.
+static unsigned int
+ink_in(const char *path, int x0, int y0, int x1, int y1){
+  cairo_surface_t *surface = cairo_image_surface_create_from_png(path);
+  assert(cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS);
+  cairo_surface_flush(surface);
+  unsigned char *data = cairo_image_surface_get_data(surface);
+  int stride = cairo_image_surface_get_stride(surface);
+  unsigned int ink = 0;
+  for(int y = y0 < 0 ? 0 : y0; y < y1 && y < cairo_image_surface_get_height(surface); y++)
+    for(int x = x0 < 0 ? 0 : x0; x < x1 && x < cairo_image_surface_get_width(surface); x++)
+      if(*(uint32_t *) (data + y * stride + x * 4) >> 24) ink++;
+  cairo_surface_destroy(surface);
+  return ink;
+}
+
 simplet_map_t*
 build_map(){
   simplet_map_t *map;
@@ -108,6 +144,79 @@ test_holes(){
   simplet_map_free(map);
 }
 
+// Two overlapping squares whose rings run in opposite directions. Drawn in
+// one path they must not cancel out where they overlap.
+void
+test_winding(){
+  simplet_map_t *map;
+  assert((map = simplet_map_new()));
+  simplet_map_set_srs(map, "+proj=longlat +ellps=GRS80 +datum=NAD83 +no_defs");
+  simplet_map_set_size(map, 256, 256);
+  simplet_map_set_bounds(map, -5, -5, 35, 35);
+  simplet_layer_t  *layer  = simplet_map_add_layer(map, "../data/winding.geojson");
+  simplet_filter_t *filter = simplet_layer_add_filter(layer, "SELECT * from 'winding'");
+  simplet_filter_add_style(filter, "fill", "#ff0000");
+  simplet_map_render_to_png(map, "./winding.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+  simplet_map_free(map);
+
+  // The middle of the overlap, then one point only in each square.
+  assert(pixel_at("./winding.png", 128, 128) == 0xffff0000);
+  assert(pixel_at("./winding.png", 64, 192) == 0xffff0000);
+  assert(pixel_at("./winding.png", 192, 64) == 0xffff0000);
+}
+
+// Two rectangles that share an edge running through the middle of a column
+// of pixels. Drawn seamless, the pixels on the edge are fully covered.
+void
+test_seamless(){
+  simplet_map_t *map;
+  assert((map = simplet_map_new()));
+  simplet_map_set_srs(map, "+proj=longlat +ellps=GRS80 +datum=NAD83 +no_defs");
+  simplet_map_set_size(map, 256, 256);
+  simplet_map_set_bounds(map, -5, -5, 35, 35);
+  simplet_layer_t  *layer  = simplet_map_add_layer(map, "../data/seamless.geojson");
+  simplet_filter_t *filter = simplet_layer_add_filter(layer, "SELECT * from 'seamless'");
+  simplet_filter_add_style(filter, "fill",     "#ff0000");
+  simplet_filter_add_style(filter, "seamless", "true");
+  simplet_map_render_to_png(map, "./seamless.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+  simplet_map_free(map);
+
+  // The edge at 10.5 degrees is at x = 99.2, rows 96 to 224 are inside.
+  for(int y = 100; y < 220; y++)
+    assert(pixel_at("./seamless.png", 99, y) == 0xffff0000);
+}
+
+// The same squares drawn translucent with an outline. Features are filled
+// as one shape, then outlined.
+void
+test_translucent(){
+  simplet_map_t *map;
+  assert((map = simplet_map_new()));
+  simplet_map_set_srs(map, "+proj=longlat +ellps=GRS80 +datum=NAD83 +no_defs");
+  simplet_map_set_size(map, 256, 256);
+  simplet_map_set_bounds(map, -5, -5, 35, 35);
+  simplet_layer_t  *layer  = simplet_map_add_layer(map, "../data/winding.geojson");
+  simplet_filter_t *filter = simplet_layer_add_filter(layer, "SELECT * from 'winding'");
+  simplet_filter_add_style(filter, "fill",   "#ff000080");
+  simplet_filter_add_style(filter, "stroke", "#0000ff");
+  simplet_filter_add_style(filter, "weight", "4");
+  simplet_map_render_to_png(map, "./translucent.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+  simplet_map_free(map);
+
+  // The overlap is no darker than a point only in one square.
+  unsigned int overlap = pixel_at("./translucent.png", 128, 128);
+  assert(overlap >> 24 == 0x80);
+  assert(overlap == pixel_at("./translucent.png", 64, 192));
+  assert(overlap == pixel_at("./translucent.png", 192, 64));
+
+  // The first square's right edge, inside the second square, isn't covered
+  // by the second square's fill.
+  assert(pixel_at("./translucent.png", 160, 128) == 0xff0000ff);
+}
+
 void
 test_points(){
 	simplet_map_t *map;
@@ -159,6 +268,219 @@ test_bunk(){
   simplet_map_free(map);
 }
 
+void
+test_data_driven(){
+  simplet_map_t *map;
+  assert((map = simplet_map_new()));
+  simplet_map_set_slippy(map, 0, 0, 0);
+  simplet_layer_t  *layer  = simplet_map_add_layer(map,
+      "../data/ne_10m_admin_0_countries.shp");
+  simplet_filter_t *filter = simplet_layer_add_filter(layer,
+      "SELECT * from 'ne_10m_admin_0_countries'");
+  simplet_filter_add_style(filter, "fill",
+      "match(MAPCOLOR7, 1:#d53e4f, 2:#fc8d59, 3:#fee08b, 4:#e6f598, 5:#99d594, 6:#3288bd, "
+      "7:#5e4fa2, #cccccc)");
+  simplet_filter_add_style(filter, "stroke", "#ffffff");
+  simplet_filter_add_style(filter, "weight",
+      "interpolate(POP_EST, 0:0.1, 100000000:1)");
+  simplet_map_render_to_png(map, "./data_driven.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+  simplet_map_free(map);
+
+  // MAPCOLOR7 is numeric and always 1 to 7, so no country gets the fallback.
+  // These are inland Russia and Brazil.
+  unsigned int russia = pixel_at("./data_driven.png", 199, 71);
+  unsigned int brazil = pixel_at("./data_driven.png", 92, 135);
+  assert(russia >> 24 == 0xff && (russia & 0xffffff) != 0xcccccc);
+  assert(brazil >> 24 == 0xff && (brazil & 0xffffff) != 0xcccccc);
+}
+
+void
+test_placed_labels(){
+  simplet_map_t *map;
+  assert((map = simplet_map_new()));
+  simplet_map_set_slippy(map, 0, 0, 1);
+  simplet_layer_t  *layer  = simplet_map_add_layer(map,
+      "../data/ne_10m_populated_places.shp");
+  simplet_filter_t *filter = simplet_layer_add_filter(layer,
+      "SELECT * from 'ne_10m_populated_places'");
+  simplet_filter_add_style(filter, "text-field", "NAME");
+  simplet_filter_add_style(filter, "font",       "Sans 8");
+  simplet_filter_add_style(filter, "color",      "#226688");
+  assert(simplet_map_place_labels(map, 1) == SIMPLET_OK);
+
+  simplet_labels_t *labels = simplet_list_get(map->labels, 0);
+  assert(labels->zoom == 1);
+  assert(labels->placements_length > 0);
+
+  // Placing the same zoom again replaces its labels.
+  assert(simplet_map_place_labels(map, 1) == SIMPLET_OK);
+  assert(simplet_list_get_length(map->labels) == 1);
+  labels = simplet_list_get(map->labels, 0);
+
+  // Find a label on the top row of tiles that straddles the edge between
+  // tiles 0 and 1, at 256 world pixels. Bounds are in world pixels, y down.
+  simplet_bounds_t *seam = NULL;
+  for(unsigned int i = 0; i < labels->placements_length && !seam; i++){
+    simplet_bounds_t *bounds = labels->placements[i]->bounds;
+    if(bounds->nw.x < 250 && bounds->se.x > 262 && bounds->se.y >= 0 && bounds->nw.y < 256)
+      seam = bounds;
+  }
+  assert(seam);
+
+  // Neighbouring tiles draw the same labels along their shared edge.
+  simplet_map_render_to_png(map, "./placed_labels_0.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+  struct simplet_arena_t *arena = map->arena;
+  assert(arena);
+  simplet_map_set_slippy(map, 1, 0, 1);
+  simplet_map_render_to_png(map, "./placed_labels_1.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+
+  // The second render reuses the first one's arena.
+  assert(map->arena == arena);
+
+  // Neighbouring tiles each draw their half of the label on the seam.
+  assert(ink_in("./placed_labels_0.png", seam->nw.x, seam->se.y, 256, seam->nw.y + 1));
+  assert(ink_in("./placed_labels_1.png", 0, seam->se.y, seam->se.x - 256, seam->nw.y + 1));
+  simplet_map_free(map);
+}
+
+// Build a map labeling populated places on the first zoom 1 tile, with at
+// most limit labels, ranked by priority if it isn't NULL.
+static simplet_map_t*
+build_label_map(const char *priority, const char *limit){
+  simplet_map_t *map;
+  assert((map = simplet_map_new()));
+  simplet_map_set_slippy(map, 0, 0, 1);
+  simplet_layer_t  *layer  = simplet_map_add_layer(map,
+      "../data/ne_10m_populated_places.shp");
+  simplet_filter_t *filter = simplet_layer_add_filter(layer,
+      "SELECT * from 'ne_10m_populated_places'");
+  simplet_filter_add_style(filter, "text-field", "NAME");
+  if(priority)
+    simplet_filter_add_style(filter, "text-priority", priority);
+  simplet_filter_add_style(filter, "text-limit", limit);
+  simplet_filter_add_style(filter, "font",       "Sans 8");
+  simplet_filter_add_style(filter, "color",      "#226688");
+  return map;
+}
+
+void
+test_label_priority(){
+  simplet_map_t *map;
+  simplet_stats_t stats;
+
+  // A tile spends its whole budget, there are far more places than that.
+  map = build_label_map("POP_MAX", "25");
+  simplet_map_render_to_png(map, "./label_priority.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+  simplet_map_get_stats(map, &stats);
+  assert(stats.labels_placed == 25);
+
+  // The most populous place is labeled before anything can collide with it.
+  // Labels placed ahead of time aren't limited per tile.
+  assert(simplet_map_place_labels(map, 1) == SIMPLET_OK);
+  simplet_labels_t *labels = simplet_list_get(map->labels, 0);
+  assert(labels->placements_length > 25);
+  assert(!strcmp(simplet_shape_get_text(labels->placements[0]->shape), "Tokyo"));
+  simplet_map_free(map);
+
+  // Without a priority, labels are placed in query order up to the limit.
+  map = build_label_map(NULL, "10");
+  simplet_map_render_to_png(map, "./label_limit.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+  simplet_map_get_stats(map, &stats);
+  assert(stats.labels_placed == 10);
+  simplet_map_free(map);
+
+  // The limit is for the whole tile, a second filter adds nothing once the
+  // first has filled it.
+  map = build_label_map(NULL, "10");
+  simplet_filter_t *filter = simplet_layer_add_filter(simplet_list_get(map->layers, 0),
+      "SELECT * from 'ne_10m_populated_places'");
+  simplet_filter_add_style(filter, "text-field", "NAME");
+  simplet_filter_add_style(filter, "text-limit", "10");
+  simplet_map_render_to_png(map, "./label_limit.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+  simplet_map_get_stats(map, &stats);
+  assert(stats.labels_placed == 10);
+  simplet_map_free(map);
+}
+
+void
+test_stats(){
+  simplet_map_t *map;
+  assert((map = simplet_map_new()));
+  simplet_map_set_slippy(map, 0, 0, 0);
+  simplet_layer_t  *layer  = simplet_map_add_layer(map,
+      "../data/ne_10m_populated_places.shp");
+  simplet_filter_t *filter = simplet_layer_add_filter(layer,
+      "SELECT * from 'ne_10m_populated_places'");
+  simplet_filter_add_style(filter, "radius",     "1");
+  simplet_filter_add_style(filter, "fill",       "#226688");
+  simplet_filter_add_style(filter, "text-field", "NAME");
+  simplet_filter_add_style(filter, "font",       "Sans 8");
+  simplet_filter_add_style(filter, "color",      "#226688");
+  simplet_map_render_to_png(map, "./stats.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+
+  simplet_stats_t stats;
+  simplet_map_get_stats(map, &stats);
+  assert(stats.features_read > 0);
+  assert(stats.features_skipped < stats.features_read);
+  assert(stats.vertices_read > 0 && stats.vertices_emitted > 0);
+  assert(stats.labels_placed > 0 && stats.labels_placed <= stats.labels_shaped);
+  assert(stats.total_time > 0 && stats.total_time >= stats.encode_time);
+  assert(stats.queries == 1 && stats.bytes_encoded > 0);
+  simplet_map_free(map);
+}
+
+void
+test_trace(){
+  simplet_map_t *map;
+  assert((map = build_map()));
+  simplet_map_set_slippy(map, 0, 0, 0);
+  simplet_trace_start();
+  simplet_map_render_to_png(map, "./trace.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+  assert(SIMPLET_OK == simplet_trace_stop("./trace.json"));
+  assert(!simplet_trace_enabled());
+  simplet_map_free(map);
+
+  char buf[1 << 16];
+  FILE *file;
+  assert((file = fopen("./trace.json", "r")));
+  size_t length = fread(buf, 1, sizeof(buf) - 1, file);
+  buf[length] = '\0';
+  fclose(file);
+  assert(!strncmp(buf, "{\"traceEvents\":[", 16));
+  assert(strstr(buf, "\"name\":\"render\""));
+  assert(strstr(buf, "\"name\":\"encode\""));
+  assert(strstr(buf, "\"name\":\"layer\""));
+  assert(strstr(buf, "\"name\":\"query\""));
+  assert(strstr(buf, "\"x\":0,\"y\":0,\"z\":0"));
+}
+
+void
+test_metrics(){
+  simplet_map_t *map;
+  assert((map = build_map()));
+  simplet_map_set_slippy(map, 0, 0, 0);
+  simplet_map_render_to_png(map, "./metrics.png");
+  assert(SIMPLET_OK == simplet_map_get_status(map));
+  simplet_map_free(map);
+
+  char *text;
+  assert(SIMPLET_OK == simplet_metrics_to_prometheus(&text));
+  assert(strstr(text, "# TYPE simplet_render_seconds histogram\n"));
+  assert(strstr(text, "simplet_render_seconds_count{zoom=\"0\"} "));
+  assert(strstr(text, "simplet_layer_queries_total{layer=\"../data/ne_10m_admin_0_countries.shp\"} "));
+  assert(strstr(text, "simplet_cache_hit_ratio{cache=\"shape\"} "));
+  assert(!strstr(text, "simplet_encoded_bytes_total 0\n"));
+  simplet_free(text);
+}
+
 cairo_status_t
 stream(void *closure, const unsigned char *data, unsigned int length){
   return CAIRO_STATUS_SUCCESS;
@@ -187,11 +509,23 @@ TASK(integration){
   test(stream);
   puts("check holes.png");
   test(holes);
+  test(winding);
+  test(seamless);
+  test(translucent);
   puts("check lines.png");
   test(lines);
   puts("check points.png");
   test(background);
   puts("check background.png");
   test(points);
+  test(data_driven);
+  puts("check data_driven.png");
+  puts("check placed_labels_0.png and placed_labels_1.png");
+  test(placed_labels);
+  test(label_priority);
+  puts("check label_priority.png and label_limit.png");
+  test(stats);
+  test(trace);
+  test(metrics);
   test(bunk);
 }
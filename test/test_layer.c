@@ -1,6 +1,8 @@
 #include "test.h"
+#include <string.h>
 #include <simple-tiles/list.h>
 #include <simple-tiles/layer.h>
+#include <simple-tiles/alloc.h>
 
 void
 test_layer(){
@@ -23,7 +25,95 @@ test_add_filter(){
   simplet_layer_free(layer);
 }
 
+void
+test_layer_zoom_range(){
+  simplet_layer_t *layer;
+  if(!(layer = simplet_layer_new("../data/tl_2010_us_cd108.shp")))
+    assert(0);
+  assert(simplet_layer_is_visible(layer, 3));
+  simplet_layer_set_zoom_range(layer, 12, SIMPLET_MAX_ZOOM);
+  assert(!simplet_layer_is_visible(layer, 3));
+  assert(simplet_layer_is_visible(layer, 12));
+  simplet_layer_free(layer);
+}
+
+void
+test_layer_name(){
+  simplet_layer_t *layer;
+  char *name;
+  if(!(layer = simplet_layer_new("PG:dbname=gis user=tiles password='s3 cret' host=db")))
+    assert(0);
+  simplet_layer_get_name(layer, &name);
+  assert(!strstr(name, "s3") && !strstr(name, "cret"));
+  assert(strstr(name, "dbname=gis") && strstr(name, "host=db"));
+  simplet_free(name);
+
+  char url[] = "postgresql://tiles:s3cret@db/gis";
+  simplet_layer_set_source(layer, url);
+  simplet_layer_get_name(layer, &name);
+  assert(!strcmp(name, "postgresql://db/gis"));
+  simplet_free(name);
+
+  simplet_layer_set_name(layer, "countries");
+  simplet_layer_get_name(layer, &name);
+  assert(!strcmp(name, "countries"));
+  simplet_free(name);
+
+  simplet_layer_set_name(layer, NULL);
+  simplet_layer_get_name(layer, &name);
+  assert(!strcmp(name, "postgresql://db/gis"));
+  simplet_free(name);
+  simplet_layer_free(layer);
+}
+
+// An allocator that runs out of memory after a number of allocations.
+static void *
+limited_malloc(size_t size, void *ctx){
+  int *left = ctx;
+  return (*left)-- > 0 ? malloc(size) : NULL;
+}
+
+static void *
+limited_realloc(void *ptr, size_t size, void *ctx){
+  int *left = ctx;
+  return (*left)-- > 0 ? realloc(ptr, size) : NULL;
+}
+
+static void
+limited_free(void *ptr, void *ctx){
+  (void) ctx;
+  free(ptr);
+}
+
+void
+test_layer_source(){
+  simplet_layer_t *layer;
+  char *name;
+  char countries[] = "../data/ne_10m_admin_0_countries.shp";
+  char url[] = "postgresql://tiles:secret@db/gis";
+  if(!(layer = simplet_layer_new("../data/tl_2010_us_cd108.shp")))
+    assert(0);
+  simplet_layer_set_source(layer, countries);
+  assert(!strcmp(layer->source, "../data/ne_10m_admin_0_countries.shp"));
+
+  // Copying the source works but naming it doesn't, so nothing changes.
+  int left = 1;
+  simplet_set_allocator(limited_malloc, limited_realloc, limited_free, &left);
+  simplet_layer_set_source(layer, url);
+  simplet_set_allocator(NULL, NULL, NULL, NULL);
+  assert(left < 0);
+  assert(layer->error.status == SIMPLET_OOM);
+  assert(!strcmp(layer->source, "../data/ne_10m_admin_0_countries.shp"));
+  simplet_layer_get_name(layer, &name);
+  assert(!strcmp(name, "../data/ne_10m_admin_0_countries.shp"));
+  simplet_free(name);
+  simplet_layer_free(layer);
+}
+
 TASK(layer){
   test(layer);
   test(add_filter);
+  test(layer_zoom_range);
+  test(layer_name);
+  test(layer_source);
 }
@@ -103,10 +103,43 @@ test_iter(){
   simplet_list_free(list);
 }
 
+static void
+test_iter_init(){
+  simplet_list_t *list = build_list();
+  simplet_listiter_t iter;
+  simplet_list_iter_init(list, &iter);
+  wrap_t *ret;
+  assert((ret = simplet_list_next(&iter))->val == 5);
+  simplet_list_iter_free(&iter);
+  assert((ret = simplet_list_next(&iter))->val == 6);
+  assert((ret = simplet_list_next(&iter))->val == 7);
+  assert(simplet_list_next(&iter) == NULL);
+  assert(simplet_list_next(&iter) == NULL);
+  simplet_list_set_item_free(list, free_wrap);
+  simplet_list_free(list);
+}
+
+static void
+test_grow(){
+  simplet_list_t *list;
+  if(!(list = simplet_list_new()))
+    assert(0);
+  for(int i = 0; i < 100; i++)
+    simplet_list_push(list, wrap_new(i));
+  assert(list->length == 100);
+  assert(((wrap_t *)simplet_list_get(list, 42))->val == 42);
+  assert(((wrap_t *)simplet_list_tail(list))->val == 99);
+  assert(!simplet_list_get(list, 100));
+  simplet_list_set_item_free(list, free_wrap);
+  simplet_list_free(list);
+}
+
 TASK(list) {
   test(push);
   test(pop);
   test(get);
   test(destroy);
   test(iter);
+  test(iter_init);
+  test(grow);
 }
@@ -60,6 +60,18 @@ test_slippy(){
   simplet_map_free(map);
 }
 
+void
+test_zoom(){
+  simplet_map_t *map;
+  assert((map = simplet_map_new()));
+  assert(simplet_map_get_zoom(map) == -1);
+  simplet_map_set_slippy(map, 1, 2, 3);
+  assert(simplet_map_get_zoom(map) == 3);
+  simplet_map_set_bounds(map, 10, 10, 0, 0);
+  assert(simplet_map_get_zoom(map) == -1);
+  simplet_map_free(map);
+}
+
 void
 test_user_data(){
   simplet_map_t *map;
@@ -74,5 +86,6 @@ TASK(map){
   test(map);
   test(proj);
   test(slippy);
+  test(zoom);
   test(user_data);
 }
@@ -0,0 +1,131 @@
+#include <pthread.h>
+#include <simple-tiles/map.h>
+#include <simple-tiles/layer.h>
+#include <simple-tiles/filter.h>
+#include <simple-tiles/render.h>
+#include "test.h"
+
+static simplet_map_t*
+build_map(){
+  simplet_map_t *map;
+  assert((map = simplet_map_new()));
+  simplet_map_set_slippy(map, 0, 0, 0);
+  simplet_layer_t  *layer  = simplet_map_add_layer(map,
+      "../data/ne_10m_admin_0_countries.shp");
+  simplet_filter_t *filter = simplet_layer_add_filter(layer,
+      "SELECT * from 'ne_10m_admin_0_countries'");
+  simplet_filter_add_style(filter, "fill",   "#061F3799");
+  simplet_filter_add_style(filter, "stroke", "#ffffff99");
+  simplet_filter_add_style(filter, "weight", "0.1");
+  return map;
+}
+
+void
+test_render_init(){
+  simplet_map_t *map;
+  assert((map = build_map()));
+  simplet_render_t render;
+  assert(simplet_render_init(&render, map) == SIMPLET_OK);
+  assert(render.map == map);
+  assert(render.width == 256);
+  assert(render.height == 256);
+  assert(render.zoom == 0);
+  assert(render.bounds.nw.x == map->bounds->nw.x);
+  assert(render.bounds.se.y == map->bounds->se.y);
+  assert(render.proj && render.proj != map->proj);
+  assert(simplet_render_is_valid(&render) == SIMPLET_OK);
+  simplet_render_release(&render);
+  simplet_map_free(map);
+}
+
+void
+test_render_slippy(){
+  simplet_map_t *map;
+  assert((map = build_map()));
+  simplet_render_t render;
+  assert(simplet_render_init(&render, map) == SIMPLET_OK);
+  simplet_render_set_slippy(&render, 0, 0, 1);
+  assert(render.zoom == 1);
+  assert(render.bounds.nw.x == -20037508.34);
+  assert(render.bounds.nw.y == 20037508.34);
+  assert(render.bounds.se.y == 0.0);
+  assert(render.bounds.se.x == 0.0);
+
+  // The map keeps its own bounds.
+  assert(simplet_map_get_zoom(map) == 0);
+  assert(map->bounds->se.x == 20037508.34);
+  simplet_render_release(&render);
+  simplet_map_free(map);
+}
+
+void
+test_render_slippy_srs(){
+  simplet_map_t *map;
+  assert((map = build_map()));
+  assert(map->mercator);
+  assert(simplet_map_set_srs(map, "epsg:4326") == SIMPLET_OK);
+  assert(!map->mercator);
+
+  // Slippy tiles are in mercator, so they can't be cut from this map.
+  simplet_render_t render;
+  assert(simplet_render_init(&render, map) == SIMPLET_OK);
+  assert(simplet_render_set_slippy(&render, 0, 0, 1) == SIMPLET_ERR);
+  assert(simplet_render_get_status(&render) == SIMPLET_ERR);
+  assert(simplet_render_is_valid(&render) == SIMPLET_ERR);
+  simplet_render_reset(&render);
+  assert(simplet_render_get_status(&render) == SIMPLET_OK);
+  simplet_render_release(&render);
+
+  assert(simplet_map_set_srs(map, SIMPLET_MERCATOR) == SIMPLET_OK);
+  assert(simplet_render_init(&render, map) == SIMPLET_OK);
+  assert(simplet_render_set_slippy(&render, 0, 0, 1) == SIMPLET_OK);
+  simplet_render_release(&render);
+  simplet_map_free(map);
+}
+
+typedef struct {
+  simplet_map_t *map;
+  unsigned int x, y;
+  simplet_status_t status;
+} tile_t;
+
+static void*
+render_tile(void *arg){
+  tile_t *tile = arg;
+  simplet_render_t render;
+  char path[64];
+  snprintf(path, sizeof(path), "./render_%u_%u.png", tile->x, tile->y);
+  simplet_render_init(&render, tile->map);
+  simplet_render_set_slippy(&render, tile->x, tile->y, 1);
+  tile->status = simplet_render_to_png(&render, path);
+  simplet_render_release(&render);
+  return NULL;
+}
+
+void
+test_render_threads(){
+  simplet_map_t *map;
+  assert((map = build_map()));
+  tile_t tiles[4];
+  pthread_t threads[4];
+  for(unsigned int i = 0; i < 4; i++){
+    tiles[i].map = map;
+    tiles[i].x = i % 2;
+    tiles[i].y = i / 2;
+    assert(!pthread_create(&threads[i], NULL, render_tile, &tiles[i]));
+  }
+  for(int i = 0; i < 4; i++){
+    pthread_join(threads[i], NULL);
+    assert(tiles[i].status == SIMPLET_OK);
+  }
+  assert(simplet_map_get_status(map) == SIMPLET_OK);
+  simplet_map_free(map);
+}
+
+TASK(render){
+  test(render_init);
+  test(render_slippy);
+  test(render_slippy_srs);
+  puts("check render_0_0.png, render_1_0.png, render_0_1.png and render_1_1.png");
+  test(render_threads);
+}
@@ -0,0 +1,86 @@
+#include <string.h>
+#include <simple-tiles/filter.h>
+#include <simple-tiles/style.h>
+#include <simple-tiles/shape.h>
+#include "test.h"
+
+void
+test_shape_cache(){
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 256, 256);
+  cairo_t *ctx = cairo_create(surface);
+  PangoContext *pango_ctx = pango_cairo_create_context(ctx);
+
+  simplet_filter_t *filter;
+  assert((filter = simplet_filter_new("SELECT * FROM TEST;")));
+  simplet_filter_add_style(filter, "text-field", "NAME");
+  simplet_filter_add_style(filter, "font",       "Sans 10");
+  simplet_compiled_styles_t styles;
+  simplet_compile_styles(filter->styles, &styles);
+
+  simplet_shape_t *first, *second, *other;
+  assert((first = simplet_shape_get(pango_ctx, "Minneapolis", &styles)));
+  assert(first->width > 0 && first->height > 0);
+  assert(first->runs_length > 0);
+  assert((second = simplet_shape_get(pango_ctx, "Minneapolis", &styles)));
+  assert(first == second);
+  assert((other = simplet_shape_get(pango_ctx, "St. Paul", &styles)));
+  assert(other != first);
+
+  // Shapes outlive the cache entries that hold them.
+  simplet_shape_cache_set_size(0);
+  assert((second = simplet_shape_get(pango_ctx, "Minneapolis", &styles)));
+  assert(first != second);
+  assert(first->width == second->width);
+  simplet_shape_cache_set_size(SIMPLET_SHAPE_CACHE_SIZE);
+
+  simplet_shape_release(first);
+  simplet_shape_release(first);
+  simplet_shape_release(second);
+  simplet_shape_release(other);
+
+  simplet_release_compiled_styles(&styles);
+  simplet_filter_free(filter);
+  g_object_unref(pango_ctx);
+  cairo_destroy(ctx);
+  cairo_surface_destroy(surface);
+}
+
+void
+test_shape_long(){
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 256, 256);
+  cairo_t *ctx = cairo_create(surface);
+  PangoContext *pango_ctx = pango_cairo_create_context(ctx);
+
+  simplet_filter_t *filter;
+  assert((filter = simplet_filter_new("SELECT * FROM TEST;")));
+  simplet_filter_add_style(filter, "text-field", "NAME");
+  simplet_filter_add_style(filter, "font",       "Sans 10");
+  simplet_compiled_styles_t styles;
+  simplet_compile_styles(filter->styles, &styles);
+
+  // Longer than the chunks glyphs are placed in, the last glyph still has
+  // to reach the end of the label.
+  char text[201];
+  memset(text, 'M', 200);
+  text[200] = '\0';
+
+  simplet_shape_t *shape;
+  assert((shape = simplet_shape_get(pango_ctx, text, &styles)));
+  simplet_shape_path(shape, ctx, 10, 10);
+  double x1, y1, x2, y2;
+  cairo_path_extents(ctx, &x1, &y1, &x2, &y2);
+  assert(x1 >= 10 && x1 < 20);
+  assert(x2 > 10 + shape->width - 20 && x2 <= 10 + shape->width + 1);
+  simplet_shape_release(shape);
+
+  simplet_release_compiled_styles(&styles);
+  simplet_filter_free(filter);
+  g_object_unref(pango_ctx);
+  cairo_destroy(ctx);
+  cairo_surface_destroy(surface);
+}
+
+TASK(shape){
+  test(shape_cache);
+  test(shape_long);
+}
@@ -1,6 +1,7 @@
 #include "test.h"
 #include <simple-tiles/filter.h>
 #include <simple-tiles/style.h>
+#include <simple-tiles/util.h>
 
 
 static void
@@ -36,7 +37,88 @@ test_lookup(){
   simplet_filter_free(filter);
 }
 
+static void
+test_compile(){
+  simplet_filter_t *filter;
+  if(!(filter = simplet_filter_new("SELECT * FROM TEST;")))
+    assert(0);
+  simplet_filter_add_style(filter, "fill",      "#ff000080");
+  simplet_filter_add_style(filter, "fill",      "#00ff00");
+  simplet_filter_add_style(filter, "stroke",    "#0000ff");
+  simplet_filter_add_style(filter, "line-cap",  "round");
+  simplet_filter_add_style(filter, "line-join", "wobbly");
+  simplet_filter_add_style(filter, "weight",    "2.5");
+  simplet_filter_add_style(filter, "seamless",  "true");
+
+  simplet_compiled_styles_t styles;
+  simplet_compile_styles(filter->styles, &styles);
+  assert(styles.set & SIMPLET_STYLE_FILL);
+  assert(styles.fill.valid);
+  assert(styles.fill.r == 255 / SIMPLET_CCEIL);
+  assert(styles.fill.g == 0);
+  assert(styles.fill.a == 128 / SIMPLET_CCEIL);
+  assert(styles.stroke.a == 1.0);
+  assert(styles.set & SIMPLET_STYLE_LINE_CAP);
+  assert(styles.line_cap == CAIRO_LINE_CAP_ROUND);
+  assert(!(styles.set & SIMPLET_STYLE_LINE_JOIN));
+  assert(styles.weight == 2.5);
+  assert(styles.set & SIMPLET_STYLE_SEAMLESS);
+  assert(!(styles.set & SIMPLET_STYLE_RADIUS));
+  assert(!styles.font_description);
+  simplet_release_compiled_styles(&styles);
+  simplet_filter_free(filter);
+}
+
+static void
+test_compile_text(){
+  simplet_filter_t *filter;
+  if(!(filter = simplet_filter_new("SELECT * FROM TEST;")))
+    assert(0);
+  simplet_filter_add_style(filter, "text-field",     "NAME");
+  simplet_filter_add_style(filter, "font",           "Futura Medium 8");
+  simplet_filter_add_style(filter, "letter-spacing", "2");
+
+  simplet_compiled_styles_t styles;
+  simplet_compile_styles(filter->styles, &styles);
+  assert(!strcmp(styles.text_field, "NAME"));
+  assert(styles.font_description);
+  assert(pango_font_description_get_size(styles.font_description) == 8 * PANGO_SCALE);
+  assert(styles.font_pixels > 10.6 && styles.font_pixels < 10.7);
+  assert(styles.text_attributes);
+  simplet_release_compiled_styles(&styles);
+  assert(!styles.font_description);
+  assert(!styles.text_attributes);
+  simplet_filter_free(filter);
+}
+
+static void
+test_fill_only(){
+  simplet_filter_t *filter;
+  if(!(filter = simplet_filter_new("SELECT * FROM TEST;")))
+    assert(0);
+  simplet_filter_add_style(filter, "text-field", "NAME");
+
+  simplet_compiled_styles_t styles;
+  simplet_compile_styles(filter->styles, &styles);
+  assert(!simplet_compiled_styles_fill_only(&styles));
+  simplet_release_compiled_styles(&styles);
+
+  simplet_filter_add_style(filter, "color", "#226688");
+  simplet_compile_styles(filter->styles, &styles);
+  assert(simplet_compiled_styles_fill_only(&styles));
+  simplet_release_compiled_styles(&styles);
+
+  simplet_filter_add_style(filter, "text-stroke-color", "#ffffff88");
+  simplet_compile_styles(filter->styles, &styles);
+  assert(!simplet_compiled_styles_fill_only(&styles));
+  simplet_release_compiled_styles(&styles);
+  simplet_filter_free(filter);
+}
+
 TASK(style) {
   test(style);
   test(lookup);
+  test(compile);
+  test(compile_text);
+  test(fill_only);
 }
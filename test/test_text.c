@@ -0,0 +1,191 @@
+#include <simple-tiles/filter.h>
+#include <simple-tiles/style.h>
+#include <simple-tiles/text.h>
+#include <simple-tiles/alloc.h>
+#include "test.h"
+
+void
+test_text_outside_extent(){
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 256, 256);
+  cairo_t *ctx = cairo_create(surface);
+  simplet_lithograph_t *litho;
+  assert((litho = simplet_lithograph_new(ctx)));
+
+  simplet_filter_t *filter;
+  assert((filter = simplet_filter_new("SELECT * FROM TEST;")));
+  simplet_filter_add_style(filter, "text-field", "NAME");
+  simplet_filter_add_style(filter, "font",       "Sans 10px");
+  simplet_compiled_styles_t styles;
+  simplet_compile_styles(filter->styles, &styles);
+  assert(styles.font_pixels > 0);
+
+  // Nothing is culled until the lithograph has an extent.
+  assert(!simplet_lithograph_outside_extent(litho, &styles, "Duluth", -1000, -1000));
+  simplet_lithograph_set_extent(litho, 256, 256, 0);
+
+  assert(!simplet_lithograph_outside_extent(litho, &styles, "Duluth", 128, 128));
+  assert(simplet_lithograph_outside_extent(litho, &styles, "Duluth", -100, 128));
+  assert(simplet_lithograph_outside_extent(litho, &styles, "Duluth", 128, 300));
+
+  // A label hanging over the edge is kept, only its width reaches the tile.
+  assert(!simplet_lithograph_outside_extent(litho, &styles, "Duluth", -25, 128));
+
+  // Each line adds to the height, so a tall label above the tile is kept.
+  assert(simplet_lithograph_outside_extent(litho, &styles, "Duluth", 128, -25));
+  assert(!simplet_lithograph_outside_extent(litho, &styles, "Du\nlu\nth", 128, -25));
+
+  // So does the halo.
+  simplet_release_compiled_styles(&styles);
+  simplet_filter_add_style(filter, "text-stroke-weight", "20");
+  simplet_compile_styles(filter->styles, &styles);
+  assert(!simplet_lithograph_outside_extent(litho, &styles, "Duluth", 128, -25));
+
+  // And the buffer.
+  simplet_lithograph_set_extent(litho, 256, 256, 100);
+  assert(!simplet_lithograph_outside_extent(litho, &styles, "Duluth", -100, 128));
+
+  simplet_release_compiled_styles(&styles);
+  simplet_filter_free(filter);
+  simplet_lithograph_free(litho);
+  cairo_destroy(ctx);
+  cairo_surface_destroy(surface);
+}
+
+// Place a shaped copy of text at x, y.
+static int
+place(simplet_lithograph_t *litho, simplet_compiled_styles_t *styles, const char *text,
+  double x, double y){
+  simplet_shape_t *shape;
+  assert((shape = simplet_shape_get(litho->pango_ctx, text, styles)));
+  return simplet_lithograph_try_placement(litho, shape, x, y);
+}
+
+void
+test_text_budget(){
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 256, 256);
+  cairo_t *ctx = cairo_create(surface);
+  simplet_lithograph_t *litho;
+  assert((litho = simplet_lithograph_new(ctx)));
+
+  simplet_filter_t *first, *second;
+  assert((first = simplet_filter_new("SELECT * FROM TEST;")));
+  assert((second = simplet_filter_new("SELECT * FROM TEST;")));
+  simplet_filter_add_style(first,  "text-field", "NAME");
+  simplet_filter_add_style(first,  "text-limit", "2");
+  simplet_filter_add_style(second, "text-field", "NAME");
+  simplet_filter_add_style(second, "text-limit", "2");
+  simplet_compiled_styles_t first_styles, second_styles;
+  simplet_compile_styles(first->styles, &first_styles);
+  simplet_compile_styles(second->styles, &second_styles);
+
+  // The budget belongs to the tile, so the second filter is full too.
+  assert(place(litho, &first_styles, "Duluth", 40, 40));
+  assert(!simplet_lithograph_is_full(litho, &first_styles));
+  assert(place(litho, &first_styles, "Ely", 200, 40));
+  assert(simplet_lithograph_is_full(litho, &first_styles));
+  assert(simplet_lithograph_is_full(litho, &second_styles));
+
+  simplet_release_compiled_styles(&first_styles);
+  simplet_release_compiled_styles(&second_styles);
+  simplet_filter_free(first);
+  simplet_filter_free(second);
+  simplet_lithograph_free(litho);
+  cairo_destroy(ctx);
+  cairo_surface_destroy(surface);
+}
+
+void
+test_text_saturation(){
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 256, 256);
+  cairo_t *ctx = cairo_create(surface);
+  simplet_lithograph_t *litho;
+  assert((litho = simplet_lithograph_new(ctx)));
+  litho->saturation = 3;
+
+  simplet_filter_t *filter;
+  assert((filter = simplet_filter_new("SELECT * FROM TEST;")));
+  simplet_filter_add_style(filter, "text-field", "NAME");
+  simplet_compiled_styles_t styles;
+  simplet_compile_styles(filter->styles, &styles);
+
+  // Only labels that collide in a row saturate the tile.
+  assert(place(litho, &styles, "Duluth", 40, 40));
+  assert(!place(litho, &styles, "Duluth", 40, 40));
+  assert(!place(litho, &styles, "Duluth", 40, 40));
+  assert(!simplet_lithograph_is_saturated(litho));
+  assert(place(litho, &styles, "Ely", 200, 200));
+  assert(!place(litho, &styles, "Duluth", 40, 40));
+  assert(!place(litho, &styles, "Duluth", 40, 40));
+  assert(!place(litho, &styles, "Ely", 200, 200));
+  assert(simplet_lithograph_is_saturated(litho));
+  assert(simplet_lithograph_is_full(litho, &styles));
+
+  simplet_release_compiled_styles(&styles);
+  simplet_filter_free(filter);
+  simplet_lithograph_free(litho);
+  cairo_destroy(ctx);
+  cairo_surface_destroy(surface);
+}
+
+// An allocator that runs out of memory after a number of allocations.
+static void *
+limited_malloc(size_t size, void *ctx){
+  int *left = ctx;
+  return (*left)-- > 0 ? malloc(size) : NULL;
+}
+
+static void *
+limited_realloc(void *ptr, size_t size, void *ctx){
+  int *left = ctx;
+  return (*left)-- > 0 ? realloc(ptr, size) : NULL;
+}
+
+static void
+limited_free(void *ptr, void *ctx){
+  (void) ctx;
+  free(ptr);
+}
+
+void
+test_text_oom(){
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 256, 256);
+  cairo_t *ctx = cairo_create(surface);
+  simplet_lithograph_t *litho;
+  assert((litho = simplet_lithograph_new(ctx)));
+
+  simplet_filter_t *filter;
+  assert((filter = simplet_filter_new("SELECT * FROM TEST;")));
+  simplet_filter_add_style(filter, "text-field", "NAME");
+  simplet_compiled_styles_t styles;
+  simplet_compile_styles(filter->styles, &styles);
+
+  assert(place(litho, &styles, "Duluth", 40, 40));
+  assert(litho->error.status == SIMPLET_OK);
+
+  // The placement and its bounds are allocated, but the grid can't index
+  // the label in its new cell, so the label is rejected.
+  simplet_shape_t *shape;
+  assert((shape = simplet_shape_get(litho->pango_ctx, "Ely", &styles)));
+  int left = 2;
+  simplet_set_allocator(limited_malloc, limited_realloc, limited_free, &left);
+  assert(!simplet_lithograph_try_placement(litho, shape, 200, 200));
+  simplet_set_allocator(NULL, NULL, NULL, NULL);
+  assert(left < 0);
+
+  assert(litho->error.status == SIMPLET_OOM);
+  assert(simplet_list_get_length(litho->placements) == 1);
+  assert(simplet_lithograph_is_full(litho, &styles));
+
+  simplet_release_compiled_styles(&styles);
+  simplet_filter_free(filter);
+  simplet_lithograph_free(litho);
+  cairo_destroy(ctx);
+  cairo_surface_destroy(surface);
+}
+
+TASK(text){
+  test(text_outside_extent);
+  test(text_budget);
+  test(text_saturation);
+  test(text_oom);
+}